@@ -0,0 +1,161 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/sort.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#include "klife.h"
+
+
+/*
+ * Benchmark of the step engine, run from /proc/klife/bench and by userspace build. Board
+ * is a scratch one, it's not visible in boards list. Soup is made by splitmix64, which
+ * must never be changed: results of different releases are comparable only while they
+ * calculate the same generations.
+ */
+
+static int bench_cmp (const void *a, const void *b);
+static int bench_fill (struct klife_board *board, const struct klife_bench_spec *spec);
+
+
+void klife_bench_defaults (struct klife_bench_spec *spec)
+{
+	spec->opts.layout = KBL_LINEAR;
+	klife_rule_conway (&spec->opts.rule);
+	spec->opts.topology = KBT_TORUS;
+	spec->opts.width = spec->opts.height = 1024;
+	spec->density = 35;
+	spec->gens = 1000;
+	spec->warmup = 10;
+	spec->threads = 1;
+	spec->seed = 1;
+}
+
+
+/*
+ * Run benchmark by spec. Every measured generation is timed, warmup ones are not. It
+ * could take long, so it's interrupted by signal.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int klife_bench_run (const struct klife_bench_spec *spec, struct klife_bench_result *res)
+{
+	struct klife_board *board;
+	ktime_t start;
+	u64 *ns;
+	unsigned int i;
+	int ret;
+
+	if (!spec->gens || spec->gens > KLIFE_BENCH_MAX_GENS || spec->density > 100 ||
+	    !spec->opts.width || !spec->opts.height)
+		return -EINVAL;
+
+	ns = vmalloc (spec->gens * sizeof (u64));
+	if (!ns)
+		return -ENOMEM;
+
+	ret = klife_create_scratch_board (&spec->opts, &board);
+	if (ret) {
+		vfree (ns);
+		return ret;
+	}
+
+	ret = board_set_threads (board, spec->threads);
+	if (!ret)
+		ret = bench_fill (board, spec);
+	if (ret)
+		goto out;
+	memset (res, 0, sizeof (*res));
+
+	for (i = 0; i < spec->warmup + spec->gens; i++) {
+		if (signal_pending (current)) {
+			ret = -EINTR;
+			goto out;
+		}
+
+		start = ktime_get ();
+		ret = board_step (board, 1);
+		if (ret)
+			goto out;
+		if (i < spec->warmup)
+			continue;
+
+		ns[i - spec->warmup] = ktime_to_ns (ktime_sub (ktime_get (), start));
+		res->total_ns += ns[i - spec->warmup];
+		res->cells += (u64)board->field_width * board->field_height;
+	}
+
+	sort (ns, spec->gens, sizeof (u64), bench_cmp, NULL);
+
+	res->kernel = klife_step_impl->name;
+	res->width = board->field_width;
+	res->height = board->field_height;
+	res->p50_ns = ns[spec->gens / 2];
+	res->p99_ns = ns[(u64)spec->gens * 99 / 100];
+	res->population = board->population;
+
+	/* in microseconds, cells * NSEC_PER_SEC could overflow */
+	res->cells_rate = div64_u64 (res->cells * USEC_PER_SEC,
+				     max_t (u64, div64_u64 (res->total_ns, NSEC_PER_USEC), 1));
+out:
+	klife_put_board (board);
+	vfree (ns);
+	return ret;
+}
+
+
+static int bench_cmp (const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+static inline u64 splitmix64 (u64 *state)
+{
+	u64 z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+
+/*
+ * Fill rectangle of spec's size row by row. Every random word gives four cells, cell is
+ * live if its 16 bits are below density.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+static int bench_fill (struct klife_board *board, const struct klife_bench_spec *spec)
+{
+	unsigned int bytes = DIV_ROUND_UP (spec->opts.width, 8), x, y;
+	u32 limit = spec->density * 65536 / 100;
+	u64 state = spec->seed, r = 0;
+	int ret = 0;
+	u8 *row;
+
+	row = vmalloc (bytes);
+	if (!row)
+		return -ENOMEM;
+
+	for (y = 0; y < spec->opts.height && !ret; y++) {
+		memset (row, 0, bytes);
+		for (x = 0; x < spec->opts.width; x++) {
+			if (!(x % 4))
+				r = splitmix64 (&state);
+			if ((r & 0xffff) < limit)
+				row[x / 8] |= 1 << (x % 8);
+			r >>= 16;
+		}
+		ret = board_put_rect (board, 0, y, spec->opts.width, 1, row);
+		cond_resched ();
+	}
+
+	vfree (row);
+	return ret;
+}
@@ -0,0 +1,102 @@
+/*
+ * Bit-sliced rule of the generation step, shared by all kernels.
+ *
+ * Every routine here works on CELLS, which is the type of 64 cells (u64) or of vector of
+ * such words, and must be defined before this file is included. Vectors are GCC vector
+ * extensions, which support the same bitwise operations and shifts as integers, so the
+ * same code is compiled for both. File is included once by every kernel implementation,
+ * so it has no include guard.
+ */
+
+
+/* s = a + b + c (lower bit), k = carry */
+#define FULL_ADD(a, b, c, s, k)				\
+	do {						\
+		CELLS __t = (a) ^ (b);			\
+		s = __t ^ (c);				\
+		k = ((a) & (b)) | (__t & (c));		\
+	} while (0)
+
+
+/* Word of west neighbours of cells in w (cell X-1), prev is the word left of w */
+static inline CELLS west (CELLS w, CELLS prev)
+{
+	return (w << 1) | (prev >> (KLIFE_WORD_BITS - 1));
+}
+
+
+/* Word of east neighbours of cells in w (cell X+1), next is the word right of w */
+static inline CELLS east (CELLS w, CELLS next)
+{
+	return (w >> 1) | (next << (KLIFE_WORD_BITS - 1));
+}
+
+
+/*
+ * Mask of cells which have exactly c live neighbours, given bits of their counts. Count
+ * could not exceed 8, so n3 means 8, and it's zero if any of lower bits is set.
+ */
+static __always_inline CELLS count_is (unsigned int c, CELLS n0, CELLS n1, CELLS n2, CELLS n3)
+{
+	CELLS m;
+
+	if (c & 8)
+		return n3;
+	m = (c & 1 ? n0 : ~n0) & (c & 2 ? n1 : ~n1) & (c & 4 ? n2 : ~n2);
+	return c ? m : m & ~n3;
+}
+
+
+/*
+ * Mask of cells which count is in set (bit N stands for N neighbours). This is the lookup
+ * of count in the table done for 64 cells at once. When set is known at compile time, only
+ * terms of its bits are left by compiler, so terms are written out instead of loop.
+ */
+#define COUNT_TERM(set, c, n0, n1, n2, n3) \
+	(-(u64)(((set) >> (c)) & 1) & count_is (c, n0, n1, n2, n3))
+
+static __always_inline CELLS count_in (u32 set, CELLS n0, CELLS n1, CELLS n2, CELLS n3)
+{
+	return COUNT_TERM (set, 0, n0, n1, n2, n3) | COUNT_TERM (set, 1, n0, n1, n2, n3) |
+		COUNT_TERM (set, 2, n0, n1, n2, n3) | COUNT_TERM (set, 3, n0, n1, n2, n3) |
+		COUNT_TERM (set, 4, n0, n1, n2, n3) | COUNT_TERM (set, 5, n0, n1, n2, n3) |
+		COUNT_TERM (set, 6, n0, n1, n2, n3) | COUNT_TERM (set, 7, n0, n1, n2, n3) |
+		COUNT_TERM (set, 8, n0, n1, n2, n3);
+}
+
+
+/*
+ * Compute next state of 64 cells of word m by rule's table. All arguments are words of
+ * neighbours, already aligned with m.
+ *
+ * Sum of eight neighbours is n = b0 + 2*(k1 + t0 + 2*t1), so its bits are n0 = b0,
+ * n1 = t0^k1, n2 = t1^(t0&k1) and n3 = t1&t0&k1. By Conway's rules cell is alive in the
+ * next generation if n == 3, or n == 2 and cell is alive now. Both cases means that
+ * k1 + t0 + 2*t1 == 1, and b0 decides between birth and survival, so this rule doesn't
+ * need full count.
+ *
+ * Table is a constant for specialized kernels, so this routine is folded for given rule.
+ */
+static __always_inline CELLS rule_word (u32 table,
+					CELLS ul, CELLS u, CELLS ur,
+					CELLS ml, CELLS m, CELLS mr,
+					CELLS dl, CELLS d, CELLS dr)
+{
+	CELLS s_u, k_u, s_m, k_m, s_d, k_d;
+	CELLS b0, k1, t0, t1, c;
+
+	FULL_ADD (ul, u, ur, s_u, k_u);
+	s_m = ml ^ mr;
+	k_m = ml & mr;
+	FULL_ADD (dl, d, dr, s_d, k_d);
+
+	FULL_ADD (s_u, s_m, s_d, b0, k1);
+	FULL_ADD (k_u, k_m, k_d, t0, t1);
+
+	if (table == KLIFE_TABLE_CONWAY)
+		return ~t1 & (t0 ^ k1) & (b0 | m);
+
+	c = t0 & k1;
+	return (~m & count_in (table & 0xffff, b0, t0 ^ k1, t1 ^ c, t1 & c)) |
+		(m & count_in (table >> 16, b0, t0 ^ k1, t1 ^ c, t1 & c));
+}
@@ -1,160 +1,800 @@
 #include "klife.h"
 #include "klife-proc.h"
+#include "klife-step.h"
+#include "klife-hash.h"
+#include "klife-trace.h"
 
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+#include <linux/rculist.h>
+#include <linux/math64.h>
+#include <asm/byteorder.h>
 
 
 /*
  * Internal routines
  */
 static inline int enlarge_needed (struct klife_board *board, unsigned long x, unsigned long y);
+static int board_alloc (char *name, const struct klife_board_opts *opts, struct klife_board **res);
+static int fit_field (struct klife_board *board, unsigned long x, unsigned long y);
 static int enlarge_field (struct klife_board *board, unsigned int new_side);
+static int create_fixed_field (struct klife_board *board, unsigned int width, unsigned int height);
+static int alloc_field (struct klife_board *board, unsigned int width, unsigned int height,
+			unsigned int power);
+static unsigned int field_power (u64 bytes);
+static u64 *field_alloc (unsigned int power, int zero);
+static void field_free (u64 *buf, unsigned int power);
+static inline void mark_changed (struct klife_board *board, unsigned long x, unsigned long y);
+static void mark_all_changed (struct klife_board *board);
+static void census_cell (struct klife_board *board, unsigned int x, unsigned int y, u64 old, u64 new);
+static inline u64 word_hash (u64 w, unsigned int wx, unsigned int y);
+static void cycle_reset (struct klife_board *board);
+static void cycle_record (struct klife_board *board);
+struct field_view;
+static inline unsigned int board_view (struct klife_board *board, struct field_view *v);
+static void get_row (struct field_view *v, unsigned long x, unsigned long y, unsigned int w, u8 *buf);
+static void put_row (struct klife_board *board, unsigned long x, unsigned long y, unsigned int w, const u8 *buf);
 static inline unsigned int get_field_side (unsigned int pages_power);
-static void copy_field (char *src, unsigned int src_side, char *dst, unsigned int dst_side);
+static void copy_field (struct klife_board *board, u64 *dst, unsigned int dst_width);
+static struct klife_stripe *alloc_stripes (struct klife_board *board, unsigned int count);
+static void free_stripes (struct klife_stripe *stripes, unsigned int count);
+static void step_stripe_work (struct work_struct *work);
+static void tile_census (struct field_view *v, unsigned int tx, unsigned int ty,
+			 struct klife_tile_info *info);
+static u64 field_census (struct field_view *v, struct klife_tile_info *info, unsigned long *live,
+			 struct klife_box *bands, u64 *hash);
+static void band_census (struct klife_board *board, unsigned int ty);
+static void board_census_box (struct klife_board *board, struct klife_box *box);
+static inline unsigned int box_side (const struct klife_box *box);
+static int step_field (struct klife_board *board, u64 *born, u64 *died);
 
 
 /*
  * Internal macroses
+ *
+ * Field is stored by 64-bit words, in order given by board's layout. For linear layout on
+ * little-endian machines byte image of field is the same as with plain bytes, where cell
+ * X is bit X%8 of byte X/8.
+ */
+#define CELL_WORD(board, x, y) (*field_word (board, (board)->field, (x) >> KLIFE_WORD_SHIFT, y))
+#define CELL_MASK(x) (1ULL << ((x) & (KLIFE_WORD_BITS - 1)))
+
+/* Field pointer and geometry taken at once. Lockless readers work with such copy, because
+ * field could be reallocated while they read it. */
+struct field_view {
+	u64 *field;
+	unsigned int width, height;
+	klife_board_layout_t layout;
+};
+
+#define VIEW_WORD(v, x, y) (*__field_word ((v)->field, (v)->layout, (v)->width >> KLIFE_WORD_SHIFT, \
+					   (x) >> KLIFE_WORD_SHIFT, y))
+
+/* attempts of lockless rectangle copy before it's taken under lock */
+#define RECT_READ_TRIES 3
+
+/* largest field buffer, side of such field still fits into unsigned int */
+#define FIELD_MAX_POWER (58 - PAGE_SHIFT)
+
+
+static int field_vmalloc = 0;
+module_param (field_vmalloc, int, 0644);
+MODULE_PARM_DESC (field_vmalloc, "Allocate field buffers: 0 - contiguous pages, vmalloc if failed, 1 - always vmalloc");
+
+
+/*
+ * Create new board with given name, which is owned by the board after success.
+ *
+ * Return index of the new board, -ERROR otherwise.
+ */
+int klife_create_board (char *name, struct klife_board_opts *opts)
+{
+	struct klife_board *board;
+	int ret;
+
+	ret = board_alloc (name, opts, &board);
+	if (ret)
+		return ret;
+
+	write_lock (&klife.lock);
+	board->index = klife.next_index++;
+	write_unlock (&klife.lock);
+
+	/* proc entries creation could sleep, so board is linked after it */
+	if (proc_create_board (board)) {
+		board->name = NULL;
+		klife_put_board (board);
+		return -ENOMEM;
+	}
+	klife_debug_create_board (board);
+
+	write_lock (&klife.lock);
+	list_add_rcu (&board->next, &klife.boards);
+	klife.boards_count++;
+	write_unlock (&klife.lock);
+
+	return board->index;
+}
+
+
+/*
+ * Create board which is not linked into boards list and has no proc entries, it's used
+ * by benchmark. It's freed by klife_put_board.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
  */
-#define CELL_BYTE(x, y, width) (((y)*(width) + x) >> 3)
-#define CELL_MASK(x) (1UL << ((x) & 0x7))
+int klife_create_scratch_board (const struct klife_board_opts *opts, struct klife_board **board)
+{
+	return board_alloc (NULL, opts, board);
+}
 
 
-int klife_create_board (char *name)
+/*
+ * Allocate board with field of fixed topology. Board gets index and is linked by caller.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+static int board_alloc (char *name, const struct klife_board_opts *opts, struct klife_board **res)
 {
 	struct klife_board *board;
+	int ret;
 
 	board = kzalloc (sizeof (struct klife_board), GFP_KERNEL);
 
 	if (!board)
 		return -ENOMEM;
 
-	write_lock (&klife.lock);
+	board->threads = 1;
+	board->stripes = alloc_stripes (board, board->threads);
+	if (!board->stripes) {
+		kfree (board);
+		return -ENOMEM;
+	}
+	init_completion (&board->stripes_done);
+
+	board->header = (struct klife_mmap_header*)get_zeroed_page (GFP_KERNEL);
+	if (!board->header) {
+		free_stripes (board->stripes, board->threads);
+		kfree (board);
+		return -ENOMEM;
+	}
+	board->header->magic = KLIFE_MMAP_MAGIC;
+	atomic_set (&board->maps, 0);
+
+	/* reference of boards list (or of benchmark, for scratch board) */
+	kref_init (&board->refs);
+
 	board->name = name;
-	board->index = klife.next_index;
 	board->lock = RW_LOCK_UNLOCKED;
+	seqcount_init (&board->seq);
+	mutex_init (&board->mutex);
+	init_waitqueue_head (&board->events_wait);
 	board->mode = KBM_STEP;
-
+	board->layout = opts->layout;
+	board->rule = opts->rule;
+	board->topology = opts->topology;
+	box_clear (&board->box);
+	box_clear (&board->changed);
+	box_clear (&board->view);
 	INIT_LIST_HEAD (&board->next);
-	list_add (&board->next, &klife.boards);
-	if (proc_create_board (board))
-		goto err;
+	board->index = -1;
 
-	klife.boards_count++;
-	klife.next_index++;
-	write_unlock (&klife.lock);
+	/* field of fixed board is allocated once, right now */
+	if (board->topology != KBT_PLANE) {
+		ret = create_fixed_field (board, opts->width, opts->height);
+		if (ret)
+			goto err;
+	}
 
+	*res = board;
 	return 0;
 err:
-	write_unlock (&klife.lock);
-	list_del (&board->next);
+	field_free (board->field, board->pages_power);
+	field_free (board->field_next, board->pages_power);
+	kfree (board->tiles_changed);
+	kfree (board->tiles_changed_next);
+	kfree (board->tiles_live);
+	kfree (board->tiles_info);
+	kfree (board->bands_box);
+	free_page ((unsigned long)board->header);
+	free_stripes (board->stripes, board->threads);
 	kfree (board);
-	kfree (name);
-	return -ENOMEM;
+	return ret;
 }
 
 
 
-/* this routine assumes that klife status strucure lock is already held */
+/*
+ * Remove board from the list and from /proc, and stop its thread. Board itself is freed
+ * when the last reference to it is dropped. This routine could sleep, so klife status
+ * structure lock must not be held.
+ *
+ * Return 0 if succeeded, -ENOENT if board is already deleted.
+ */
 int klife_delete_board (struct klife_board *board)
 {
 	BUG_ON (!board);
 
-	list_del (&board->next);
+	write_lock (&klife.lock);
+	if (board->dead) {
+		write_unlock (&klife.lock);
+		return -ENOENT;
+	}
+	board->dead = 1;
+	list_del_rcu (&board->next);
+	klife.boards_count--;
+	write_unlock (&klife.lock);
+
+	board_stop (board);
+
+	/* readers of events get end of file */
+	wake_up_interruptible (&board->events_wait);
 
-	write_lock (&board->lock);
+	/* waits for proc handlers, which could take board's mutex */
 	proc_delete_board (board);
-	free_pages ((unsigned long)board->field, board->pages_power);
-	write_unlock (&board->lock);
+	klife_debug_delete_board (board);
+
+	/* lookups which still see the board in list take their references before list's
+	 * one is dropped */
+	synchronize_rcu ();
+	klife_put_board (board);
 
 	return 0;
 }
 
 
+static void klife_release_board (struct kref *kref)
+{
+	struct klife_board *board = container_of (kref, struct klife_board, refs);
+
+	field_free (board->field, board->pages_power);
+	field_free (board->field_next, board->pages_power);
+	hashlife_destroy (board->hashlife);
+	free_page ((unsigned long)board->header);
+	free_stripes (board->stripes, board->threads);
+	kfree (board->tiles_changed);
+	kfree (board->tiles_changed_next);
+	kfree (board->tiles_live);
+	kfree (board->tiles_info);
+	kfree (board->bands_box);
+	kfree (board->name);
+	kfree (board);
+}
+
+
+/*
+ * Find board by index and take reference to it, which must be dropped by klife_put_board.
+ *
+ * Returns NULL if there is no such board.
+ */
+struct klife_board *klife_find_board (int index)
+{
+	struct klife_board *board;
+
+	rcu_read_lock ();
+	list_for_each_entry_rcu (board, &klife.boards, next)
+		if (board->index == index) {
+			klife_get_board (board);
+			rcu_read_unlock ();
+			return board;
+		}
+	rcu_read_unlock ();
+
+	return NULL;
+}
+
+
+void klife_get_board (struct klife_board *board)
+{
+	kref_get (&board->refs);
+}
+
+
+void klife_put_board (struct klife_board *board)
+{
+	kref_put (&board->refs, klife_release_board);
+}
+
+
 /*
  * Board management routines
  */
 int board_get_cell (struct klife_board *board, unsigned long x, unsigned long y)
 {
+	struct field_view v;
+	unsigned int seq;
 	int res;
 
-	read_lock (&board->lock);
+	rcu_read_lock ();
+	do {
+		seq = board_view (board, &v);
+		if (x >= v.width || y >= v.height)
+			res = -EINVAL;
+		else
+			res = (VIEW_WORD (&v, x, y) & CELL_MASK (x)) ? 1 : 0;
+	} while (board_read_retry (board, seq));
+	rcu_read_unlock ();
+
+	return res;
+}
+
+
+int board_set_cell (struct klife_board *board, unsigned long x, unsigned long y)
+{
+	struct klife_cell_change change = { .x = x, .y = y, .op = KLIFE_CELL_SET };
 
-	if (max (x, y) > board->side)
+	if (max (x, y) >= KLIFE_SIDE_MAX)
 		return -EINVAL;
 
-	res = board->field[CELL_BYTE (x, y, board->field_side)] & CELL_MASK (x);
-	res = res ? 1 : 0;
+	return board_apply_changes (board, &change, 1);
+}
 
-	read_unlock (&board->lock);
 
-	return res;
+int board_clear_cell (struct klife_board *board, unsigned long x, unsigned long y)
+{
+	struct klife_cell_change change = { .x = x, .y = y, .op = KLIFE_CELL_CLEAR };
+
+	if (max (x, y) >= KLIFE_SIDE_MAX)
+		return -EINVAL;
+
+	return board_apply_changes (board, &change, 1);
 }
 
 
-int board_set_cell (struct klife_board *board, unsigned long x, unsigned long y)
+int board_toggle_cell (struct klife_board *board, unsigned long x, unsigned long y)
 {
-	int ret = 0;
+	struct klife_cell_change change = { .x = x, .y = y, .op = KLIFE_CELL_TOGGLE };
+
+	if (max (x, y) >= KLIFE_SIDE_MAX)
+		return -EINVAL;
+
+	return board_apply_changes (board, &change, 1);
+}
 
-	write_lock (&board->lock);
 
-	if (enlarge_needed (board, x, y)) {
-		printk (KERN_INFO "Enlarge needed to process set of cell %lu,%lu\n", x, y);
-		ret = enlarge_field (board, max (x, y));
+/*
+ * Apply array of n cell changes. Field is enlarged once to hold all of them, and all
+ * changes are made under one lock, so readers see them at once. Fixed board is not
+ * changed at all if some of cells are outside of it.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int board_apply_changes (struct klife_board *board, const struct klife_cell_change *changes,
+			 unsigned long n)
+{
+	unsigned long i, top_x = 0, top_y = 0, side = 0;
+	u64 *word, old;
+	ktime_t start;
+	int ret;
+
+	if (!n)
+		return 0;
+	start = ktime_get ();
+
+	for (i = 0; i < n; i++) {
+		if (changes[i].op > KLIFE_CELL_TOGGLE ||
+		    max (changes[i].x, changes[i].y) >= KLIFE_SIDE_MAX)
+			return -EINVAL;
+		top_x = max (top_x, (unsigned long)changes[i].x);
+		top_y = max (top_y, (unsigned long)changes[i].y);
+		if (changes[i].op != KLIFE_CELL_CLEAR)
+			side = max (side, (unsigned long)max (changes[i].x, changes[i].y) + 1);
 	}
 
+	mutex_lock (&board->mutex);
+
+	ret = fit_field (board, top_x, top_y);
+
 	if (!ret) {
-		/* check for side change */
-		if (board->side < max (x, y))
-			board->side = max (x, y) + 1;
+		board_write_lock (board);
+		board_frame_begin (board);
+
+		for (i = 0; i < n; i++) {
+			word = &CELL_WORD (board, changes[i].x, changes[i].y);
+			old = *word;
+
+			switch (changes[i].op) {
+			case KLIFE_CELL_SET:
+				*word |= CELL_MASK (changes[i].x);
+				break;
+			case KLIFE_CELL_CLEAR:
+				*word &= ~CELL_MASK (changes[i].x);
+				break;
+			case KLIFE_CELL_TOGGLE:
+				*word ^= CELL_MASK (changes[i].x);
+				break;
+			}
+			if (old != *word)
+				census_cell (board, changes[i].x, changes[i].y, old, *word);
+			mark_changed (board, changes[i].x, changes[i].y);
+		}
 
-/* 		printk (KERN_INFO "%lu,%lu, ofs = %lu, mask = %lx\n", x, y, CELL_BYTE (x, y, board->field_side << 3), CELL_MASK (x)); */
-		board->field[CELL_BYTE (x, y, board->field_side)] |= CELL_MASK (x);
+		/* side is only an upper bound of live area */
+		board->side = max_t (unsigned long, board->side, side);
+		cycle_reset (board);
+		board_frame_end (board);
+		write_unlock (&board->lock);
 	}
 
-	write_unlock (&board->lock);
+	mutex_unlock (&board->mutex);
 
-	return 0;
+	if (!ret)
+		trace_klife_batch_apply (board, n, ktime_to_ns (ktime_sub (ktime_get (), start)));
+	return ret;
 }
 
 
-int board_clear_cell (struct klife_board *board, unsigned long x, unsigned long y)
+/*
+ * Copy rectangle of w x h cells at (x, y) to buf, packed row by row. Every row takes
+ * (w+7)/8 bytes, cell X is bit X%8 of byte X/8 (counting from x). Cells outside of the
+ * field are dead. Rectangle is consistent: it's copied without lock and copy is repeated
+ * if field changed meanwhile. If field changes all the time, copy is made under lock.
+ */
+void board_get_rect (struct klife_board *board, unsigned int x, unsigned int y,
+		     unsigned int w, unsigned int h, u8 *buf)
 {
-	int ret = 0;
+	unsigned int row, seq, tries, bytes = DIV_ROUND_UP (w, 8);
+	struct field_view v;
+
+	rcu_read_lock ();
+	for (tries = 0; tries < RECT_READ_TRIES; tries++) {
+		seq = board_view (board, &v);
+		for (row = 0; row < h; row++)
+			get_row (&v, x, (unsigned long)y + row, w, buf + (unsigned long)row * bytes);
+		if (!board_read_retry (board, seq)) {
+			rcu_read_unlock ();
+			return;
+		}
+	}
+	rcu_read_unlock ();
+
+	read_lock (&board->lock);
+	v.field = board->field;
+	v.width = board->field_width;
+	v.height = board->field_height;
+	v.layout = board->layout;
+	for (row = 0; row < h; row++)
+		get_row (&v, x, (unsigned long)y + row, w, buf + (unsigned long)row * bytes);
+	read_unlock (&board->lock);
+}
+
+
+/*
+ * Replace cells of w x h rectangle at (x, y) with contents of buf, packed as in
+ * board_get_rect. Field is enlarged once to hold the whole rectangle, rectangle must be
+ * inside of fixed board.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int board_put_rect (struct klife_board *board, unsigned int x, unsigned int y,
+		    unsigned int w, unsigned int h, const u8 *buf)
+{
+	u64 x1 = (u64)x + w, y1 = (u64)y + h;
+	unsigned int row, tx, ty, tile, bytes = DIV_ROUND_UP (w, 8);
+	struct klife_tile_info *info;
+	struct field_view v;
+	int ret;
+
+	if (!w || !h)
+		return 0;
+
+	if (max (x1, y1) > KLIFE_SIDE_MAX)
+		return -EINVAL;
 
-	write_lock (&board->lock);
+	mutex_lock (&board->mutex);
 
-	if (enlarge_needed (board, x, y)) {
-		printk (KERN_INFO "Enlarge needed to process set of cell %lu,%lu\n", x, y);
-		ret = enlarge_field (board, max (x, y));
+	ret = fit_field (board, x1 - 1, y1 - 1);
+
+	if (!ret) {
+		board_write_lock (board);
+		board_frame_begin (board);
+
+		for (row = 0; row < h; row++)
+			put_row (board, x, y + row, w, buf + (unsigned long)row * bytes);
+
+		/* census of touched tiles is made again */
+		v.field = board->field;
+		v.width = board->field_width;
+		v.height = board->field_height;
+		v.layout = board->layout;
+
+		for (ty = y >> KLIFE_TILE_SHIFT; ty <= (y1 - 1) >> KLIFE_TILE_SHIFT; ty++) {
+			for (tx = x >> KLIFE_TILE_SHIFT; tx <= (x1 - 1) >> KLIFE_TILE_SHIFT; tx++) {
+				tile = board_tile_index (board, tx, ty);
+				info = &board->tiles_info[tile];
+				board->population -= info->pop;
+				board->hash ^= info->hash;
+				tile_census (&v, tx, ty, info);
+				board->population += info->pop;
+				board->hash ^= info->hash;
+				if (info->pop)
+					__set_bit (tile, board->tiles_live);
+				else
+					__clear_bit (tile, board->tiles_live);
+				__set_bit (tile, board->tiles_changed);
+			}
+			band_census (board, ty);
+		}
+		box_add (&board->changed, x >> KLIFE_TILE_SHIFT, y >> KLIFE_TILE_SHIFT,
+			 ((x1 - 1) >> KLIFE_TILE_SHIFT) + 1, ((y1 - 1) >> KLIFE_TILE_SHIFT) + 1);
+		board_census_box (board, &board->box);
+		cycle_reset (board);
+
+		board->side = max_t (u64, board->side, max (x1, y1));
+		board_frame_end (board);
+		write_unlock (&board->lock);
 	}
 
-	if (!ret)
-		board->field[CELL_BYTE (x, y, board->field_side)] &= ~CELL_MASK (x);
+	mutex_unlock (&board->mutex);
 
-	write_unlock (&board->lock);
+	return ret;
+}
 
-	return 0;
+
+/*
+ * Life engine
+ */
+
+/*
+ * Advance board by given amount of generations. Cells outside of the field are dead, but
+ * when live cells reach right or bottom border of plane, field is enlarged before the
+ * generation is computed, so patterns can grow (stepping fails if field can't be enlarged,
+ * e.g. while it's mapped). Fixed boards keep their size: bounded one
+ * loses cells which cross the border, torus wraps them to the opposite edge.
+ *
+ * Generation is computed into field_next buffer, which then becomes the field. Only
+ * swap of buffers is done under board's lock, so readers are not blocked by calculation.
+ * Long request is interrupted by signal, generations done before it are kept.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int board_step (struct klife_board *board, unsigned long gens)
+{
+	unsigned long gen;
+	struct klife_box box;
+	u64 *tmp, born, died, step_ns;
+	ktime_t start;
+	int ret = 0;
+
+	for (gen = 0; gen < gens; gen++) {
+		if (signal_pending (current)) {
+			ret = -EINTR;
+			break;
+		}
+
+		mutex_lock (&board->mutex);
+
+		if (!board->field) {
+			/* nothing lives here, the rest of generations is done at once as by board_jump */
+			board_write_lock (board);
+			board_frame_begin (board);
+			board->generation += gens - gen;
+			board_frame_end (board);
+			board_generation_done (board);
+			write_unlock (&board->lock);
+			mutex_unlock (&board->mutex);
+
+			write_lock (&klife.lock);
+			klife.ticks += gens - gen;
+			write_unlock (&klife.lock);
+			break;
+		}
+
+		/* pattern must not die at the edge, stepping stops if field can't grow */
+		if (board->topology == KBT_PLANE && board->side >= board->field_width) {
+			ret = enlarge_field (board, board->side + 1);
+			if (unlikely (ret)) {
+				mutex_unlock (&board->mutex);
+				break;
+			}
+		}
+
+		/* the first generation of history is recorded before it's stepped */
+		if (!board->history_count)
+			cycle_record (board);
+
+		trace_klife_gen_start (board);
+		start = ktime_get ();
+		ret = step_field (board, &born, &died);
+		if (unlikely (ret)) {
+			mutex_unlock (&board->mutex);
+			break;
+		}
+		step_ns = board_lat_add (board, KLIFE_LAT_STEP, start);
+
+		board_census_box (board, &box);
+		board_delta_emit (board, board->generation + 1);
+
+		board_write_lock (board);
+		board_frame_begin (board);
+		tmp = board->field;
+		board->field = board->field_next;
+		board->field_next = tmp;
+
+		board->box = box;
+		board->side = box_side (&box);
+		board->population += born - died;
+		board->births = born;
+		board->deaths = died;
+		board->generation++;
+		cycle_record (board);
+		board_frame_end (board);
+		board_generation_done (board);
+		write_unlock (&board->lock);
+
+		trace_klife_gen_end (board, step_ns);
+		mutex_unlock (&board->mutex);
+
+		write_lock (&klife.lock);
+		klife.ticks++;
+		write_unlock (&klife.lock);
+
+		cond_resched ();
+	}
+
+	return ret;
 }
 
 
-int board_toggle_cell (struct klife_board *board, unsigned long x, unsigned long y)
+/*
+ * Advance board by 2^k generations at once by HashLife engine. It is much faster than
+ * board_step for large k and regular patterns, but takes memory for node cache of the
+ * board, which is kept between jumps.
+ *
+ * HashLife calculates infinite plane, so pattern could leave the field. Field is enlarged
+ * to keep right and bottom parts (if allocation succeeds), but cells which moved to
+ * negative coordinates are lost. Borders of fixed boards are not known to HashLife, so they
+ * could be only stepped.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int board_jump (struct klife_board *board, unsigned int k)
 {
+	unsigned int extent;
+	struct field_view v;
+	struct klife_box box;
+	u64 *tmp, pop;
 	int ret = 0;
 
-	write_lock (&board->lock);
+	if (k > KLIFE_JUMP_MAX)
+		return -EINVAL;
+
+	if (board->topology != KBT_PLANE)
+		return -EOPNOTSUPP;
+
+	mutex_lock (&board->mutex);
+
+	if (!board->field) {
+		/* nothing lives here */
+		board_write_lock (board);
+		board_frame_begin (board);
+		board->generation += 1ULL << k;
+		board_frame_end (board);
+		board_generation_done (board);
+		write_unlock (&board->lock);
+		goto out;
+	}
 
-	if (enlarge_needed (board, x, y)) {
-		printk (KERN_INFO "Enlarge needed to process set of cell %lu,%lu\n", x, y);
-		ret = enlarge_field (board, max (x, y));
+	if (!board->hashlife) {
+		board->hashlife = hashlife_create (&board->rule);
+		if (!board->hashlife) {
+			ret = -ENOMEM;
+			goto out;
+		}
 	}
 
+	ret = hashlife_load (board->hashlife, board);
 	if (!ret)
-		board->field[CELL_BYTE (x, y, board->field_side)] ^= CELL_MASK (x);
+		ret = hashlife_advance (board->hashlife, k);
+	if (ret)
+		goto out;
+
+	/* if enlarge fails, pattern is clipped by the field */
+	extent = hashlife_extent (board->hashlife);
+	if (extent > board->field_width)
+		enlarge_field (board, extent);
+
+	hashlife_store (board->hashlife, board, board->field_next);
+
+	/* back buffer is the old generation now, every tile could differ */
+	mark_all_changed (board);
+
+	/* there are no results of stepper, so census is made by the field */
+	v.field = board->field_next;
+	v.width = board->field_width;
+	v.height = board->field_height;
+	v.layout = board->layout;
+	pop = field_census (&v, board->tiles_info, board->tiles_live, board->bands_box, &board->hash);
+	board_census_box (board, &box);
+
+	board_delta_emit (board, board->generation + (1ULL << k));
+
+	board_write_lock (board);
+	board_frame_begin (board);
+	tmp = board->field;
+	board->field = board->field_next;
+	board->field_next = tmp;
+
+	board->box = box;
+	board->side = box_side (&box);
+	board->population = pop;
+	board->births = board->deaths = 0;
+	board->generation += 1ULL << k;
+	cycle_reset (board);
+	board_frame_end (board);
+	board_generation_done (board);
+	write_unlock (&board->lock);
+
+out:
+	mutex_unlock (&board->mutex);
+
+	if (!ret) {
+		write_lock (&klife.lock);
+		klife.ticks += 1ULL << k;
+		write_unlock (&klife.lock);
+	}
+
+	return ret;
+}
+
+
+/*
+ * Change rule of the board. Tiles which are stable by old rule could change by new one,
+ * so all tiles are calculated in the next generation, and HashLife cache, which keeps
+ * results of old rule, is dropped.
+ */
+int board_set_rule (struct klife_board *board, const struct klife_rule *rule)
+{
+	mutex_lock (&board->mutex);
+
+	board->rule = *rule;
 
+	if (board->field)
+		mark_all_changed (board);
+
+	/* generations of old rule could repeat by chance only */
+	board_write_lock (board);
+	cycle_reset (board);
 	write_unlock (&board->lock);
 
+	hashlife_destroy (board->hashlife);
+	board->hashlife = NULL;
+
+	mutex_unlock (&board->mutex);
+
+	return 0;
+}
+
+
+/*
+ * Set amount of workers which calculate generation of the board.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int board_set_threads (struct klife_board *board, unsigned int threads)
+{
+	struct klife_stripe *stripes;
+
+	if (!threads || threads > KLIFE_MAX_THREADS)
+		return -EINVAL;
+
+	stripes = alloc_stripes (board, threads);
+	if (!stripes)
+		return -ENOMEM;
+
+	/* no stripes are queued while mutex is held */
+	mutex_lock (&board->mutex);
+	swap (board->stripes, stripes);
+	swap (board->threads, threads);
+	mutex_unlock (&board->mutex);
+
+	free_stripes (stripes, threads);
+
 	return 0;
 }
 
@@ -165,64 +805,993 @@ int board_toggle_cell (struct klife_board *board, unsigned long x, unsigned long
 
 /*
  * Routine checks that cell with given coordinates are inside of
- * allocated board's area. Assume that lock is held at least for reading.
+ * allocated board's area. Assume that board's mutex or lock is held.
  */
 static inline int enlarge_needed (struct klife_board *board, unsigned long x, unsigned long y)
 {
-	return board->field_side <= max(x, y);
+	return board->field_width <= x || board->field_height <= y;
 }
 
 
 /*
- * Realloc board's field to make it at least new_side side (in bits). Write lock must be held.
+ * Make sure that cell (x, y) is inside of the field. Plane is enlarged if needed, but
+ * fixed board could not hold cells outside of it. Board's mutex must be held.
  *
  * Return 0 if succeeded, -ERROR otherwise.
  */
-static int enlarge_field (struct klife_board *board, unsigned int new_side)
+static int fit_field (struct klife_board *board, unsigned long x, unsigned long y)
 {
-	unsigned int pages;
-	unsigned int new_bytes, new_power, tmp, new_side_actual;
-	char *new_buf;
+	if (!enlarge_needed (board, x, y))
+		return 0;
 
-	new_bytes = (new_side + 7) >> 3;
-	pages = (new_bytes * (new_bytes << 3) + PAGE_SIZE - 1) / PAGE_SIZE;
+	if (board->topology != KBT_PLANE || max (x, y) >= KLIFE_SIDE_MAX)
+		return -EINVAL;
 
-	/* We know needed amount of pages to provide required board side, but we must find nearest
-	 * greater 2^X. */
-	new_power = 0;
-	tmp = 1;
-	while (tmp < pages) {
-		new_power++;
-		tmp <<= 1;
+	return enlarge_field (board, max (x, y) + 1);
+}
+
+
+/*
+ * Mark tile containing cell as changed, so it will be calculated in next generation.
+ * Board's mutex must be held.
+ */
+static inline void mark_changed (struct klife_board *board, unsigned long x, unsigned long y)
+{
+	unsigned int tx = x >> KLIFE_TILE_SHIFT, ty = y >> KLIFE_TILE_SHIFT;
+
+	__set_bit (board_tile_index (board, tx, ty), board->tiles_changed);
+	box_add (&board->changed, tx, ty, tx + 1, ty + 1);
+}
+
+
+/* Mark every tile as changed, so the whole field is calculated in next generation */
+static void mark_all_changed (struct klife_board *board)
+{
+	bitmap_fill (board->tiles_changed, board_tiles (board));
+	board->changed.x0 = board->changed.y0 = 0;
+	board->changed.x1 = board->field_width >> KLIFE_TILE_SHIFT;
+	board->changed.y1 = board->field_height >> KLIFE_TILE_SHIFT;
+}
+
+
+/*
+ * Account cell (x, y) which became live or dead by cell change in census, old and new are
+ * its word before and after change. Box of tile is only extended, it becomes exact when
+ * the tile is calculated. Board's lock must be held for write.
+ */
+static void census_cell (struct klife_board *board, unsigned int x, unsigned int y, u64 old, u64 new)
+{
+	unsigned int tx = x >> KLIFE_TILE_SHIFT, ty = y >> KLIFE_TILE_SHIFT;
+	unsigned int tile = board_tile_index (board, tx, ty);
+	struct klife_tile_info *info = &board->tiles_info[tile];
+	unsigned int cx = x & (KLIFE_TILE_WORDS - 1), cy = y & (KLIFE_TILE_WORDS - 1);
+	u64 hash = word_hash (old, tx, y) ^ word_hash (new, tx, y);
+
+	info->hash ^= hash;
+	board->hash ^= hash;
+
+	if (!(new & CELL_MASK (x))) {
+		board->population--;
+		if (!--info->pop)
+			__clear_bit (tile, board->tiles_live);
+		return;
+	}
+
+	board->population++;
+	if (!info->pop++) {
+		__set_bit (tile, board->tiles_live);
+		info->x0 = info->x1 = cx;
+		info->y0 = info->y1 = cy;
+	}
+	info->x0 = min_t (u8, info->x0, cx);
+	info->y0 = min_t (u8, info->y0, cy);
+	info->x1 = max_t (u8, info->x1, cx + 1);
+	info->y1 = max_t (u8, info->y1, cy + 1);
+
+	box_add (&board->bands_box[ty], x, y, x + 1, y + 1);
+	box_add (&board->box, x, y, x + 1, y + 1);
+}
+
+
+/*
+ * Cycle detection. Every generation is recorded in history ring by hash of the field, and
+ * if hash and population of new generation are the same as of recorded one, pattern is
+ * periodic (still life has period 1). History is dropped when field is modified not by
+ * stepper, because generations before and after modification are not related.
+ */
+
+/* Forget history of the board. Board's mutex and lock (for write) must be held. */
+static void cycle_reset (struct klife_board *board)
+{
+	board->history_count = 0;
+	board->period = 0;
+	board->period_gen = 0;
+}
+
+
+/*
+ * Record current generation in history, and find its period if it's not known yet. Board's
+ * mutex and lock (for write) must be held, lock isn't needed for the first generation of
+ * history, which could not repeat anything.
+ */
+static void cycle_record (struct klife_board *board)
+{
+	struct klife_cycle_entry *e;
+	unsigned int i, n = min_t (u64, board->history_count, KLIFE_CYCLE_HISTORY);
+	unsigned long long period;
+
+	/* the latest repetition gives the least period, multiples of it could be there too */
+	for (i = 0, period = 0; i < n && !board->period; i++) {
+		e = &board->history[i];
+		if (e->hash == board->hash && e->population == board->population &&
+		    (!period || board->generation - e->generation < period))
+			period = board->generation - e->generation;
+	}
+
+	if (period) {
+		board->period = period;
+		board->period_gen = board->generation;
+	}
+
+	e = &board->history[board->history_count++ % KLIFE_CYCLE_HISTORY];
+	e->generation = board->generation;
+	e->hash = board->hash;
+	e->population = board->population;
+}
+
+
+/*
+ * Take consistent view of board's field without lock. Returned seq must be checked by
+ * board_read_retry after the field is read. Must be called under rcu_read_lock, which
+ * keeps buffers of the view from freeing.
+ */
+static inline unsigned int board_view (struct klife_board *board, struct field_view *v)
+{
+	unsigned int seq;
+
+	do {
+		seq = board_read_begin (board);
+		v->field = board->field;
+		v->width = board->field_width;
+		v->height = board->field_height;
+		v->layout = board->layout;
+	} while (board_read_retry (board, seq));
+
+	return seq;
+}
+
+
+/*
+ * Returns 8 cells starting at (x, y) packed to byte, cells outside of the field are dead.
+ */
+static inline u8 get_cells8 (struct field_view *v, unsigned long x, unsigned long y)
+{
+	unsigned int bit = x & (KLIFE_WORD_BITS - 1);
+	u64 val;
+
+	if (x >= v->width || y >= v->height)
+		return 0;
+
+	val = VIEW_WORD (v, x, y) >> bit;
+	if (bit > KLIFE_WORD_BITS - 8 && x + KLIFE_WORD_BITS - bit < v->width)
+		val |= VIEW_WORD (v, x + KLIFE_WORD_BITS - bit, y) << (KLIFE_WORD_BITS - bit);
+
+	return val & 0xff;
+}
+
+
+/*
+ * Replace cells selected by mask of 8 cells starting at (x, y) with val. Cells must be
+ * inside of the field. Board's lock must be held for write.
+ */
+static inline void put_cells8 (struct klife_board *board, unsigned long x, unsigned long y, u8 val, u8 mask)
+{
+	unsigned int bit = x & (KLIFE_WORD_BITS - 1);
+	u64 *w = &CELL_WORD (board, x, y);
+
+	*w = (*w & ~((u64)mask << bit)) | ((u64)(val & mask) << bit);
+	if (bit > KLIFE_WORD_BITS - 8) {
+		w = &CELL_WORD (board, x + KLIFE_WORD_BITS - bit, y);
+		bit = KLIFE_WORD_BITS - bit;
+		*w = (*w & ~((u64)mask >> bit)) | ((u64)(val & mask) >> bit);
+	}
+}
+
+
+/*
+ * Amount of bytes of row y starting at x which are placed in memory one after another.
+ * On little-endian machines byte image of word is the same as packed cells, so such bytes
+ * could be copied as is. x must be inside of the field and aligned by 8.
+ */
+static inline unsigned int row_run_bytes (struct field_view *v, unsigned long x)
+{
+	if (v->layout == KBL_LINEAR)
+		return (v->width - x) >> 3;
+	return (KLIFE_WORD_BITS - (x & (KLIFE_WORD_BITS - 1))) >> 3;
+}
+
+
+/* Copy w cells of row y starting at x to buf */
+static void get_row (struct field_view *v, unsigned long x, unsigned long y, unsigned int w, u8 *buf)
+{
+	unsigned int i = 0, n, bytes = DIV_ROUND_UP (w, 8);
+	unsigned long cx;
+
+#ifdef __LITTLE_ENDIAN
+	if (!(x & 7) && y < v->height) {
+		while (i < bytes && x + i * 8 < v->width) {
+			cx = x + i * 8;
+			n = min (row_run_bytes (v, cx), bytes - i);
+			memcpy (buf + i, (u8*)&VIEW_WORD (v, cx, y) + ((cx & (KLIFE_WORD_BITS - 1)) >> 3), n);
+			i += n;
+		}
+		memset (buf + i, 0, bytes - i);
+		i = bytes;
+	}
+#endif
+
+	for (; i < bytes; i++)
+		buf[i] = get_cells8 (v, x + i * 8, y);
+
+	if (w & 7)
+		buf[bytes - 1] &= (1 << (w & 7)) - 1;
+}
+
+
+/* Copy w cells from buf to row y starting at x, cells must be inside of the field */
+static void put_row (struct klife_board *board, unsigned long x, unsigned long y, unsigned int w, const u8 *buf)
+{
+	struct field_view v = { board->field, board->field_width, board->field_height, board->layout };
+	unsigned int i = 0, n, full = w >> 3;
+	unsigned long cx;
+
+#ifdef __LITTLE_ENDIAN
+	if (!(x & 7)) {
+		while (i < full) {
+			cx = x + i * 8;
+			n = min (row_run_bytes (&v, cx), full - i);
+			memcpy ((u8*)&CELL_WORD (board, cx, y) + ((cx & (KLIFE_WORD_BITS - 1)) >> 3), buf + i, n);
+			i += n;
+		}
 	}
+#endif
+
+	for (; i < full; i++)
+		put_cells8 (board, x + i * 8, y, buf[i], 0xff);
+
+	if (w & 7)
+		put_cells8 (board, x + full * 8, y, buf[full], (1 << (w & 7)) - 1);
+}
+
+
+/*
+ * Realloc board's field to make it at least new_side side (in bits). Board's mutex must be
+ * held, lock must not.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+static int enlarge_field (struct klife_board *board, unsigned int new_side)
+{
+	unsigned int new_power, new_side_actual;
+	u64 new_words;
+
+	if (new_side > KLIFE_SIDE_MAX)
+		return -EFBIG;
+
+	/* rows are stored by whole words */
+	new_words = ((u64)new_side + KLIFE_WORD_BITS - 1) >> KLIFE_WORD_SHIFT;
+
+	/* We know needed amount of bytes to provide required board side, but we must find
+	 * nearest greater 2^X pages. */
+	new_power = field_power (new_words * sizeof (u64) * (new_words << KLIFE_WORD_SHIFT));
+
+	if (new_power > FIELD_MAX_POWER)
+		return -EFBIG;
+
+	/* mapped buffers can't be replaced */
+	if (atomic_read (&board->maps))
+		return -EBUSY;
 
 	new_side_actual = get_field_side (new_power);
 
 	printk (KERN_INFO "Enlarge field (requested side %u). %llu pages -> %llu pages. Result side %u\n",
 		new_side, board->field ? (1ULL << board->pages_power) : 0, 1ULL << new_power, new_side_actual);
 
-	new_buf = (char*)__get_free_pages (__GFP_ZERO | GFP_KERNEL, new_power);
+	return alloc_field (board, new_side_actual, new_side_actual, new_power);
+}
+
+
+/*
+ * Allocate field of fixed board, which is not allocated yet. Width and height must be
+ * multiples of tile side: torus wraps and bounded board clips exactly at the field's edge,
+ * and kernels know no edges inside of words and tiles.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+static int create_fixed_field (struct klife_board *board, unsigned int width, unsigned int height)
+{
+	u64 w = width, h = height;
+	unsigned int power;
+
+	if (!w || !h || (w | h) & (KLIFE_TILE_WORDS - 1))
+		return -EINVAL;
+
+	if (max (w, h) > KLIFE_SIDE_MAX)
+		return -EFBIG;
+
+	power = field_power ((w >> 3) * h);
+	if (power > FIELD_MAX_POWER)
+		return -EFBIG;
+
+	printk (KERN_INFO "Allocate fixed field %llux%llu, %llu pages\n", w, h, 1ULL << power);
+
+	return alloc_field (board, w, h, power);
+}
+
+
+/*
+ * Least power of 2 pages which hold given amount of bytes. Result is greater than
+ * FIELD_MAX_POWER if there is no such field.
+ */
+static unsigned int field_power (u64 bytes)
+{
+	u64 pages = div_u64 (bytes + PAGE_SIZE - 1, PAGE_SIZE), tmp = 1;
+	unsigned int power = 0;
+
+	while (tmp < pages && power <= FIELD_MAX_POWER) {
+		power++;
+		tmp <<= 1;
+	}
+
+	return power;
+}
+
 
-	if (unlikely (!new_buf)) {
-		printk (KERN_WARNING "Failed to allocate %llu pages\n", 1ULL << new_power);
+/*
+ * Replace board's field with the new one of width x height cells in buffers of 2^power
+ * pages, cells of the old field are copied to it. Field must not be mapped. Board's mutex
+ * must be held, lock must not.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+static int alloc_field (struct klife_board *board, unsigned int width, unsigned int height,
+			unsigned int power)
+{
+	u64 *new_buf, *new_next, pop = 0, hash = 0;
+	unsigned long *changed, *changed_next, *live;
+	struct klife_tile_info *info;
+	struct klife_box *bands, box;
+	struct field_view v;
+	unsigned int tiles, ty, old_width = board->field_width;
+	ktime_t start, copy_start;
+	u64 alloc_ns, copy_ns;
+
+	start = ktime_get ();
+	/* both buffers are mapped to user whole, so none of them keeps stale pages */
+	new_buf = field_alloc (power, 1);
+	new_next = field_alloc (power, 1);
+
+	/* tile maps */
+	tiles = (width >> KLIFE_TILE_SHIFT) * (height >> KLIFE_TILE_SHIFT);
+	changed = kcalloc (BITS_TO_LONGS (tiles), sizeof (long), GFP_KERNEL);
+	changed_next = kcalloc (BITS_TO_LONGS (tiles), sizeof (long), GFP_KERNEL);
+	live = kcalloc (BITS_TO_LONGS (tiles), sizeof (long), GFP_KERNEL);
+	info = kcalloc (tiles, sizeof (struct klife_tile_info), GFP_KERNEL);
+	bands = kmalloc ((height >> KLIFE_TILE_SHIFT) * sizeof (struct klife_box), GFP_KERNEL);
+
+	if (unlikely (!new_buf || !new_next || !changed || !changed_next || !live || !info || !bands)) {
+		printk (KERN_WARNING "Failed to allocate 2x%llu pages\n", 1ULL << power);
+		field_free (new_buf, power);
+		field_free (new_next, power);
+		kfree (changed);
+		kfree (changed_next);
+		kfree (live);
+		kfree (info);
+		kfree (bands);
 		return -ENOMEM;
 	}
 
+	alloc_ns = board_lat_add (board, KLIFE_LAT_ALLOC, start);
+	copy_start = ktime_get ();
+
+	/* now we must move existing data, field can't change while mutex is held */
 	if (board->field) {
-		/* now we must move existing data */
-		copy_field (board->field, board->field_side >> 3, new_buf, new_side_actual >> 3);
-		/* ok, free old board */
-		free_pages ((unsigned long)board->field, board->pages_power);
+		copy_field (board, new_buf, width);
+
+		/* cells are moved, so census is made again */
+		v.field = new_buf;
+		v.width = width;
+		v.height = height;
+		v.layout = board->layout;
+		pop = field_census (&v, info, live, bands, &hash);
+	}
+	else
+		for (ty = 0; ty < height >> KLIFE_TILE_SHIFT; ty++)
+			box_clear (&bands[ty]);
+
+	box_clear (&box);
+	for (ty = 0; ty < height >> KLIFE_TILE_SHIFT; ty++)
+		box_union (&box, &bands[ty]);
+	copy_ns = board_lat_add (board, KLIFE_LAT_COPY, copy_start);
+
+	board_write_lock (board);
+	board_frame_begin (board);
+	swap (board->field, new_buf);
+	swap (board->field_next, new_next);
+	board->buffers[0] = board->field;
+	board->buffers[1] = board->field_next;
+	swap (board->pages_power, power);
+	swap (board->tiles_changed, changed);
+	swap (board->tiles_changed_next, changed_next);
+	swap (board->tiles_live, live);
+	swap (board->tiles_info, info);
+	swap (board->bands_box, bands);
+	board->field_width = width;
+	board->field_height = height;
+	board->population = pop;
+	board->hash = hash;
+	board->box = box;
+
+	/* field_next is empty, so every tile must be calculated in next generation */
+	mark_all_changed (board);
+	board->field_vmapped = is_vmalloc_addr (board->field) || is_vmalloc_addr (board->field_next);
+	board->alloc_ns = ktime_to_ns (ktime_sub (ktime_get (), start));
+	board_frame_end (board);
+	write_unlock (&board->lock);
+
+	trace_klife_enlarge (board, old_width, alloc_ns, copy_ns);
+
+	/* lockless readers could still use old buffers and maps */
+	synchronize_rcu ();
+
+	kfree (changed);
+	kfree (changed_next);
+	kfree (live);
+	kfree (info);
+	kfree (bands);
+
+	/* ok, free old board */
+	field_free (new_buf, power);
+	field_free (new_next, power);
+
+	return 0;
+}
+
+
+/*
+ * Allocate field buffer of 2^power pages, zeroed if requested. Physically contiguous block
+ * is preferred, because it lies in kernel's linear mapping, which is mapped by huge pages,
+ * so stepper makes less TLB misses on it. But such blocks are limited by MAX_ORDER and
+ * could be unavailable on fragmented memory, in this case buffer is taken from vmalloc.
+ */
+static u64 *field_alloc (unsigned int power, int zero)
+{
+	unsigned long size = PAGE_SIZE << power;
+	void *buf = NULL;
+
+	if (!field_vmalloc && power < MAX_ORDER)
+		buf = (void*)__get_free_pages (GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY |
+					       (zero ? __GFP_ZERO : 0), power);
+
+	if (!buf) {
+		buf = vmalloc (size);
+		if (buf && zero)
+			memset (buf, 0, size);
+	}
+
+	return buf;
+}
+
+
+static void field_free (u64 *buf, unsigned int power)
+{
+	if (!buf)
+		return;
+
+	if (is_vmalloc_addr (buf))
+		vfree (buf);
+	else
+		free_pages ((unsigned long)buf, power);
+}
+
+
+
+/*
+ * Allocate array of stripes for the board
+ */
+static struct klife_stripe *alloc_stripes (struct klife_board *board, unsigned int count)
+{
+	struct klife_stripe *stripes;
+	unsigned int i;
+
+	stripes = kcalloc (count, sizeof (struct klife_stripe), GFP_KERNEL);
+	if (unlikely (!stripes))
+		return NULL;
+
+	for (i = 0; i < count; i++) {
+		INIT_WORK (&stripes[i].work, step_stripe_work);
+		stripes[i].board = board;
+	}
+
+	return stripes;
+}
+
+
+static void free_stripes (struct klife_stripe *stripes, unsigned int count)
+{
+	unsigned int i;
+
+	if (!stripes)
+		return;
+
+	for (i = 0; i < count; i++)
+		kfree (stripes[i].stat);
+	kfree (stripes);
+}
+
+
+/*
+ * Find tile next to (tx, ty) in direction (dx, dy), each of them is -1, 0 or 1. Torus
+ * wraps around its edges, other fields have nothing outside.
+ *
+ * Returns 0 if there is no such tile.
+ */
+static inline int near_tile (struct klife_board *board, unsigned int tx, unsigned int ty,
+			     int dx, int dy, unsigned int *x, unsigned int *y)
+{
+	unsigned int tiles_x = board->field_width >> KLIFE_TILE_SHIFT;
+	unsigned int tiles_y = board->field_height >> KLIFE_TILE_SHIFT;
+
+	/* -1 becomes UINT_MAX here, which is outside too */
+	*x = tx + dx;
+	*y = ty + dy;
+
+	if (board->topology == KBT_TORUS) {
+		if (*x >= tiles_x)
+			*x = dx < 0 ? tiles_x - 1 : 0;
+		if (*y >= tiles_y)
+			*y = dy < 0 ? tiles_y - 1 : 0;
+		return 1;
 	}
 
-	board->field = new_buf;
-	board->pages_power = new_power;
-	board->field_side = new_side_actual;
+	return *x < tiles_x && *y < tiles_y;
+}
+
 
+/*
+ * Tile must be calculated if it or one of its neighbours changed in the last generation.
+ * Otherwise, field_next already contains the same data as field.
+ */
+static inline int tile_active (struct klife_board *board, unsigned int tx, unsigned int ty)
+{
+	unsigned int x, y;
+	int dx, dy;
+
+	for (dy = -1; dy <= 1; dy++)
+		for (dx = -1; dx <= 1; dx++)
+			if (near_tile (board, tx, ty, dx, dy, &x, &y) &&
+			    test_bit (board_tile_index (board, x, y), board->tiles_changed))
+				return 1;
 	return 0;
 }
 
 
+/*
+ * Census of live cells
+ */
+
+/* Set box of tile's info from OR of its words and mask of its non-empty rows */
+static inline void tile_info_box (struct klife_tile_info *info, u64 cols, u64 rows)
+{
+	info->x0 = __ffs64 (cols);
+	info->x1 = fls64 (cols);
+	info->y0 = __ffs64 (rows);
+	info->y1 = fls64 (rows);
+}
+
+
+/*
+ * Hash of word wx of row y of the field. Empty words have zero hash, and others are
+ * mixed with their position, so hash of the field is the same if it's reallocated.
+ */
+static inline u64 word_hash (u64 w, unsigned int wx, unsigned int y)
+{
+	if (!w)
+		return 0;
+
+	w ^= (((u64)y << 32) | wx) * 0x9e3779b97f4a7c15ULL;
+	w ^= w >> 33;
+	w *= 0xff51afd7ed558ccdULL;
+	w ^= w >> 33;
+	w *= 0xc4ceb9fe1a85ec53ULL;
+	return w ^ (w >> 33);
+}
+
+
+/* Count live cells of tile (tx, ty) of the field */
+static void tile_census (struct field_view *v, unsigned int tx, unsigned int ty,
+			 struct klife_tile_info *info)
+{
+	unsigned int words = v->width >> KLIFE_WORD_SHIFT, r, y, pop = 0;
+	u64 w, cols = 0, rows = 0, hash = 0;
+
+	for (r = 0; r < KLIFE_TILE_WORDS; r++) {
+		y = (ty << KLIFE_TILE_SHIFT) + r;
+		w = *__field_word (v->field, v->layout, words, tx, y);
+		if (!w)
+			continue;
+		cols |= w;
+		rows |= 1ULL << r;
+		pop += hweight64 (w);
+		hash ^= word_hash (w, tx, y);
+	}
+
+	info->pop = pop;
+	info->hash = hash;
+	if (pop)
+		tile_info_box (info, cols, rows);
+}
+
+
+/* Hash of tile (tx, ty) of field buffer of the board */
+static u64 tile_hash (struct klife_board *board, u64 *field, unsigned int tx, unsigned int ty)
+{
+	unsigned int r, y;
+	u64 hash = 0;
+
+	for (r = 0; r < KLIFE_TILE_WORDS; r++) {
+		y = (ty << KLIFE_TILE_SHIFT) + r;
+		hash ^= word_hash (*field_word (board, field, tx, y), tx, y);
+	}
+
+	return hash;
+}
+
+
+/*
+ * Count live cells of the whole field into given census arrays (see klife_board), it's
+ * used only when census of stepper is not available. Returns population, and hash of the
+ * field in hash.
+ */
+static u64 field_census (struct field_view *v, struct klife_tile_info *info, unsigned long *live,
+			 struct klife_box *bands, u64 *hash)
+{
+	unsigned int tiles_x = v->width >> KLIFE_TILE_SHIFT, tiles_y = v->height >> KLIFE_TILE_SHIFT;
+	unsigned int tx, ty, x, y, tile;
+	u64 pop = 0;
+
+	*hash = 0;
+
+	for (ty = 0; ty < tiles_y; ty++) {
+		box_clear (&bands[ty]);
+		for (tx = 0; tx < tiles_x; tx++) {
+			tile = ty * tiles_x + tx;
+			tile_census (v, tx, ty, &info[tile]);
+			if (!info[tile].pop) {
+				__clear_bit (tile, live);
+				continue;
+			}
+			__set_bit (tile, live);
+			pop += info[tile].pop;
+			*hash ^= info[tile].hash;
+			x = tx << KLIFE_TILE_SHIFT;
+			y = ty << KLIFE_TILE_SHIFT;
+			box_add (&bands[ty], x + info[tile].x0, y + info[tile].y0,
+				 x + info[tile].x1, y + info[tile].y1);
+		}
+	}
+
+	return pop;
+}
+
+
+/* Find box of live cells of band ty from census of its live tiles */
+static void band_census (struct klife_board *board, unsigned int ty)
+{
+	unsigned int first = board_tile_index (board, 0, ty);
+	unsigned int end = first + (board->field_width >> KLIFE_TILE_SHIFT);
+	struct klife_box *box = &board->bands_box[ty];
+	struct klife_tile_info *info;
+	unsigned int tile, x, y = ty << KLIFE_TILE_SHIFT;
+
+	box_clear (box);
+	for (tile = find_next_bit (board->tiles_live, end, first); tile < end;
+	     tile = find_next_bit (board->tiles_live, end, tile + 1)) {
+		info = &board->tiles_info[tile];
+		x = (tile - first) << KLIFE_TILE_SHIFT;
+		box_add (box, x + info->x0, y + info->y0, x + info->x1, y + info->y1);
+	}
+}
+
+
+/* Box of live cells of the board is union of boxes of its bands */
+static void board_census_box (struct klife_board *board, struct klife_box *box)
+{
+	unsigned int ty;
+
+	box_clear (box);
+	for (ty = 0; ty < board->field_height >> KLIFE_TILE_SHIFT; ty++)
+		box_union (box, &board->bands_box[ty]);
+}
+
+
+/* Side of square from origin, which holds box (see side of klife_board) */
+static inline unsigned int box_side (const struct klife_box *box)
+{
+	return box_empty (box) ? 0 : max (box->x1, box->y1);
+}
+
+
+/*
+ * Account results of calculated tile: mark it changed and (non-)empty, update its census.
+ * Cells died in the tile are found from its old population, so kernel counts only births.
+ * Hash is calculated again only for changed tiles.
+ */
+static inline void tile_done (struct klife_stripe *stripe, unsigned int tx, unsigned int ty,
+			      struct klife_step_stat *stat)
+{
+	struct klife_board *board = stripe->board;
+	unsigned int tile = board_tile_index (board, tx, ty);
+	struct klife_tile_info *info = &board->tiles_info[tile];
+	u64 hash;
+
+	stripe->born += stat->born;
+	stripe->died += info->pop + stat->born - stat->pop;
+
+	/* bits of other stripes could be in the same word, so atomic ops are used */
+	if (stat->diff) {
+		set_bit (tile, board->tiles_changed_next);
+		box_add (&stripe->changed, tx, ty, tx + 1, ty + 1);
+
+		hash = stat->pop ? tile_hash (board, board->field_next, tx, ty) : 0;
+		stripe->hash ^= info->hash ^ hash;
+		info->hash = hash;
+	}
+
+	if (stat->pop) {
+		set_bit (tile, board->tiles_live);
+		tile_info_box (info, stat->live, stat->rows);
+	}
+	else
+		clear_bit (tile, board->tiles_live);
+	info->pop = stat->pop;
+
+	stripe->active++;
+}
+
+
+/*
+ * Calculate active tiles of the stripe from field into field_next. Rows outside of the
+ * stripe are only read, so stripes of one generation could be calculated in parallel.
+ * Only columns of tiles [tx0, tx1) of the stripe could be active. Torus is wrapped by
+ * passing tiles of the opposite edge as neighbours, so kernel doesn't know about it. Tiles
+ * are calculated by chunks of KLIFE_STEP_CHUNK.
+ */
+static void step_stripe_tiled (struct klife_stripe *stripe)
+{
+	struct klife_board *board = stripe->board;
+	unsigned int tx, ty, x, y, i, j, chunk = 0;
+	const u64 *near[9];
+	struct klife_step_stat stat;
+
+	klife_step_begin ();
+	for (ty = stripe->y0 >> KLIFE_TILE_SHIFT; ty < stripe->y1 >> KLIFE_TILE_SHIFT; ty++) {
+		for (tx = stripe->tx0; tx < stripe->tx1; tx++) {
+			if (!tile_active (board, tx, ty))
+				continue;
+
+			for (i = 0; i < 3; i++)
+				for (j = 0; j < 3; j++) {
+					if (near_tile (board, tx, ty, j - 1, i - 1, &x, &y))
+						near[i*3 + j] = field_tile (board, board->field, x, y);
+					else
+						near[i*3 + j] = NULL;
+				}
+
+			klife_step_tile (&board->rule, near, field_tile (board, board->field_next, tx, ty),
+					 &stat);
+			tile_done (stripe, tx, ty, &stat);
+
+			/* let scheduler in between chunks */
+			if (++chunk == KLIFE_STEP_CHUNK) {
+				klife_step_end ();
+				chunk = 0;
+				klife_step_begin ();
+			}
+		}
+		band_census (board, ty);
+	}
+	klife_step_end ();
+}
+
+
+/*
+ * Linear layout is calculated by bands of 64 rows, but only runs of active tiles of every
+ * band are passed to the kernel, by chunks of KLIFE_STEP_CHUNK words. Torus is wrapped by
+ * passing the opposite row as neighbour of edge rows, and by kernel itself for edge words.
+ */
+static void step_stripe_linear (struct klife_stripe *stripe)
+{
+	struct klife_board *board = stripe->board;
+	unsigned int words = board->field_width >> KLIFE_WORD_SHIFT;
+	unsigned long last = (unsigned long)(board->field_height - 1) * words;
+	unsigned long band = (unsigned long)KLIFE_TILE_WORDS * words;
+	int torus = board->topology == KBT_TORUS;
+	unsigned int ty, y, from, to, tx, i, n;
+	u64 *src, *dst, *up, *down;
+
+	for (ty = stripe->y0 >> KLIFE_TILE_SHIFT; ty < stripe->y1 >> KLIFE_TILE_SHIFT; ty++) {
+		y = ty << KLIFE_TILE_SHIFT;
+		src = board->field + (unsigned long)y * words;
+		dst = board->field_next + (unsigned long)y * words;
+
+		if (likely (y))
+			up = src - words;
+		else
+			up = torus ? board->field + last : NULL;
+
+		if (likely (y + KLIFE_TILE_WORDS < board->field_height))
+			down = src + band;
+		else
+			down = torus ? board->field : NULL;
+
+		for (from = stripe->tx0; from < stripe->tx1; from = to) {
+			/* find next run of active tiles */
+			while (from < stripe->tx1 && !tile_active (board, from, ty))
+				from++;
+			for (to = from; to < stripe->tx1 && tile_active (board, to, ty); to++)
+				;
+			if (from == to)
+				break;
+
+			memset (stripe->stat + from, 0, (to - from) * sizeof (struct klife_step_stat));
+
+			for (i = from; i < to; i += n) {
+				n = min (to - i, (unsigned int)KLIFE_STEP_CHUNK);
+				klife_step_begin ();
+				klife_step_band (&board->rule, up, src, down, dst, KLIFE_TILE_WORDS,
+						 i, i + n, words, torus, stripe->stat);
+				klife_step_end ();
+			}
+
+			/* word of row is a column of tile, so tile's results are in one item */
+			for (tx = from; tx < to; tx++)
+				tile_done (stripe, tx, ty, &stripe->stat[tx]);
+		}
+		band_census (board, ty);
+	}
+}
+
+
+static void step_stripe (struct klife_stripe *stripe)
+{
+	stripe->born = stripe->died = stripe->hash = 0;
+	box_clear (&stripe->changed);
+	stripe->active = 0;
+
+	if (stripe->board->layout == KBL_TILED)
+		step_stripe_tiled (stripe);
+	else
+		step_stripe_linear (stripe);
+}
+
+
+static void step_stripe_work (struct work_struct *work)
+{
+	struct klife_stripe *stripe = container_of (work, struct klife_stripe, work);
+	struct klife_board *board = stripe->board;
+
+	step_stripe (stripe);
+
+	if (atomic_dec_and_test (&board->stripes_pending))
+		complete (&board->stripes_done);
+}
+
+
+/*
+ * Find box of tiles which could be active: changed tiles and their neighbours. Torus wraps
+ * neighbours of edge tiles to the opposite edge, so box which touches edge isn't narrowed.
+ */
+static void step_box (struct klife_board *board, struct klife_box *box)
+{
+	unsigned int tiles_x = board->field_width >> KLIFE_TILE_SHIFT;
+	unsigned int tiles_y = board->field_height >> KLIFE_TILE_SHIFT;
+	struct klife_box *changed = &board->changed;
+
+	if (box_empty (changed)) {
+		box->x0 = box->y0 = box->x1 = box->y1 = 0;
+		return;
+	}
+
+	box->x0 = changed->x0 ? changed->x0 - 1 : 0;
+	box->y0 = changed->y0 ? changed->y0 - 1 : 0;
+	box->x1 = min (changed->x1 + 1, tiles_x);
+	box->y1 = min (changed->y1 + 1, tiles_y);
+
+	if (board->topology == KBT_TORUS) {
+		if (!changed->x0 || changed->x1 == tiles_x) {
+			box->x0 = 0;
+			box->x1 = tiles_x;
+		}
+		if (!changed->y0 || changed->y1 == tiles_y) {
+			box->y0 = 0;
+			box->y1 = tiles_y;
+		}
+	}
+}
+
+
+/*
+ * Calculate next generation of the board into field_next. Only bands of 64 rows which
+ * could have active tiles are calculated, they are split between stripes, amount of
+ * stripes is limited by board's threads. Census of other bands doesn't change. Returns
+ * amount of cells born and died, hash of the field is updated. Board's mutex must be held.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+static int step_field (struct klife_board *board, u64 *born, u64 *died)
+{
+	unsigned int i, count, bands, words;
+	struct klife_stripe *stripe;
+	struct klife_box box;
+	unsigned long *tmp;
+
+	step_box (board, &box);
+
+	words = board->field_width >> KLIFE_WORD_SHIFT;
+	bands = box.y1 - box.y0;
+	count = min (board->threads, bands);
+
+	for (i = 0; i < count; i++) {
+		stripe = &board->stripes[i];
+		stripe->y0 = (box.y0 + bands * i / count) << KLIFE_TILE_SHIFT;
+		stripe->y1 = (box.y0 + bands * (i+1) / count) << KLIFE_TILE_SHIFT;
+		stripe->tx0 = box.x0;
+		stripe->tx1 = box.x1;
+
+		/* per-word results of linear kernel, reallocated only when field grows */
+		if (board->layout == KBL_LINEAR && stripe->stat_words < words) {
+			kfree (stripe->stat);
+			stripe->stat = kmalloc (words * sizeof (struct klife_step_stat), GFP_KERNEL);
+			stripe->stat_words = stripe->stat ? words : 0;
+			if (!stripe->stat)
+				return -ENOMEM;
+		}
+	}
+
+	if (count > 1) {
+		init_completion (&board->stripes_done);
+		atomic_set (&board->stripes_pending, count-1);
+		for (i = 1; i < count; i++)
+			queue_work (klife.wq, &board->stripes[i].work);
+	}
+
+	if (count)
+		step_stripe (&board->stripes[0]);
+
+	if (count > 1)
+		wait_for_completion (&board->stripes_done);
+
+	*born = *died = 0;
+	box_clear (&board->changed);
+	board->tiles_active = 0;
+	for (i = 0; i < count; i++) {
+		*born += board->stripes[i].born;
+		*died += board->stripes[i].died;
+		board->hash ^= board->stripes[i].hash;
+		box_union (&board->changed, &board->stripes[i].changed);
+		board->tiles_active += board->stripes[i].active;
+	}
+
+	/* changes of this generation become 'last generation' ones */
+	tmp = board->tiles_changed;
+	board->tiles_changed = board->tiles_changed_next;
+	board->tiles_changed_next = tmp;
+	bitmap_zero (board->tiles_changed_next, board_tiles (board));
+
+	return 0;
+}
+
 
 /*
  * Routine calculates side of field which have 2^pages_power pages allocated.
@@ -241,51 +1810,65 @@ static int enlarge_field (struct klife_board *board, unsigned int new_side)
 
 static inline unsigned int get_field_side (unsigned int pages_power)
 {
-	unsigned long n = (1UL << pages_power) * PAGE_SIZE;
-	unsigned int s, g0, g1;
-	unsigned long n1;
+	u64 n = (1ULL << pages_power) * PAGE_SIZE;
+	unsigned int s;
+	u64 n1, g0, g1;
 
-	BUG_ON (pages_power+PAGE_SHIFT > 32);
+	BUG_ON (pages_power > FIELD_MAX_POWER);
 	n <<= 3;
 
-	pr_debug ("get_field_side: n = %lu, let's calculate isqrt of it\n", n);
+	pr_debug ("get_field_side: n = %llu, let's calculate isqrt of it\n", n);
 
 	n1 = n - 1;
 	s = 1;
+	UPDATE_APPROX (n1, s, 32);
 	UPDATE_APPROX (n1, s, 16);
 	UPDATE_APPROX (n1, s, 8);
 	UPDATE_APPROX (n1, s, 4);
 	UPDATE_APPROX (n1, s, 2);
 
-	g0 = 1 << s;
+	g0 = 1ULL << s;
 	g1 = (g0 + (n >> s)) >> 1;
 
-	pr_debug ("n1 = %lu, s = %u, g0 = %u, g1 = %u\n", n1, s, g0, g1);
+	pr_debug ("n1 = %llu, s = %u, g0 = %llu, g1 = %llu\n", n1, s, g0, g1);
 
 	while (g1 < g0) {
 		g0 = g1;
-		g1 = (g0 + (n / g0)) >> 1;
-		pr_debug ("g0 = %u, g1 = %u\n", g0, g1);
+		g1 = (g0 + div64_u64 (n, g0)) >> 1;
+		pr_debug ("g0 = %llu, g1 = %llu\n", g0, g1);
 	}
 
-	/* ok, we got isqrt of n in bits, but we must round this down to nearest byte */
-	g0 = (g0 >> 3) << 3;
-	pr_debug ("Result is %u\n", g0);
+	/* ok, we got isqrt of n in bits, but we must round this down to nearest word */
+	g0 = (g0 >> KLIFE_WORD_SHIFT) << KLIFE_WORD_SHIFT;
+	pr_debug ("Result is %llu\n", g0);
 
 	return g0;
 }
 
 
 /*
- * Copy field data from source to dest, take in attention that dest is larger than src.
- * Dest is already filled with zeroes.
+ * Copy board's field to dest, take in attention that dest is larger than field. Dest is
+ * already filled with zeroes and has the same layout, dst_width is given in bits.
  */
-static void copy_field (char *src, unsigned int src_side, char *dst, unsigned int dst_side)
+static void copy_field (struct klife_board *board, u64 *dst, unsigned int dst_width)
 {
-	unsigned int x;
+	unsigned int src_words = board->field_width >> KLIFE_WORD_SHIFT;
+	unsigned int dst_words = dst_width >> KLIFE_WORD_SHIFT;
+	unsigned int tx, ty, y;
+
+	if (board->layout == KBL_TILED) {
+		/* tiles are not changed, only their positions */
+		for (ty = 0; ty < board->field_height >> KLIFE_TILE_SHIFT; ty++)
+			for (tx = 0; tx < src_words; tx++)
+				memcpy (__field_word (dst, KBL_TILED, dst_words, tx, ty << KLIFE_TILE_SHIFT),
+					field_tile (board, board->field, tx, ty),
+					KLIFE_TILE_WORDS * sizeof (u64));
+		return;
+	}
 
-	for (x = 0; x < src_side; x++)
-		memcpy (dst + x * dst_side, src + x * src_side, src_side);
+	for (y = 0; y < board->field_height; y++)
+		memcpy (dst + (unsigned long)y * dst_words, board->field + (unsigned long)y * src_words,
+			src_words * sizeof (u64));
 }
 
 
@@ -296,7 +1879,8 @@ void klife_dump_board (struct klife_board *board)
 	unsigned long i, lim;
 
 	read_lock (&board->lock);
-	printk (KERN_INFO "\nKlife debug dump of board '%s', side %d:\n", board->name, board->field_side);
+	printk (KERN_INFO "\nKlife debug dump of board '%s', field %ux%u:\n", board->name,
+		board->field_width, board->field_height);
 
 	printk (KERN_INFO "Field: ");
 
@@ -305,11 +1889,11 @@ void klife_dump_board (struct klife_board *board)
 	else {
 		printk ("\n");
 
-		lim = (1UL << board->pages_power) * PAGE_SIZE;
+		lim = PAGE_SIZE << board->pages_power;
 
 		for (i = 0; i < lim; i++) {
-			printk ("%02x ", (int)board->field[i]);
-			if ((i+1) % (board->field_side >> 3) == 0)
+			printk ("%02x ", (int)((unsigned char*)board->field)[i]);
+			if ((i+1) % (board->field_width >> 3) == 0)
 				printk ("\n" KERN_INFO);
 		}
 
@@ -0,0 +1,159 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/math64.h>
+
+#include "klife.h"
+
+#define CREATE_TRACE_POINTS
+#include "klife-trace.h"
+
+
+/*
+ * Debugfs interface: klife/<index> file of every board shows latency histograms of its
+ * phases, write to it resets them. Debugfs is optional, boards work without it.
+ */
+
+static struct dentry *debug_root;
+
+const char *klife_lat_names[KLIFE_LAT_PHASES] = {
+	[KLIFE_LAT_STEP] = "step",
+	[KLIFE_LAT_LOCK] = "lock",
+	[KLIFE_LAT_ALLOC] = "alloc",
+	[KLIFE_LAT_COPY] = "copy",
+	[KLIFE_LAT_PROC_READ] = "proc_read",
+	[KLIFE_LAT_PROC_WRITE] = "proc_write",
+};
+
+static const struct file_operations debug_lat_fops;
+
+
+int klife_debug_init (void)
+{
+	debug_root = debugfs_create_dir ("klife", NULL);
+	if (IS_ERR_OR_NULL (debug_root)) {
+		printk (KERN_INFO "klife: debugfs is not available, latency histograms are not shown\n");
+		debug_root = NULL;
+	}
+	return 0;
+}
+
+
+void klife_debug_exit (void)
+{
+	debugfs_remove_recursive (debug_root);
+}
+
+
+void klife_debug_create_board (struct klife_board *board)
+{
+	char name[16];
+
+	if (!debug_root)
+		return;
+
+	snprintf (name, sizeof (name), "%d", board->index);
+	board->debug_entry = debugfs_create_file (name, 0644, debug_root, board, &debug_lat_fops);
+	if (IS_ERR (board->debug_entry))
+		board->debug_entry = NULL;
+}
+
+
+void klife_debug_delete_board (struct klife_board *board)
+{
+	debugfs_remove (board->debug_entry);
+	board->debug_entry = NULL;
+}
+
+
+/*
+ * Every phase is shown by its count and average, followed by non-empty buckets as
+ * [low, high) ns ranges. The last bucket has no upper bound.
+ */
+static int debug_lat_show (struct seq_file *m, void *v)
+{
+	struct klife_board *board = m->private;
+	struct klife_lat_hist *hist;
+	unsigned int phase, i;
+	u64 count, n;
+
+	for (phase = 0; phase < KLIFE_LAT_PHASES; phase++) {
+		hist = &board->lat[phase];
+		count = atomic64_read (&hist->count);
+
+		seq_printf (m, "%s:\tcount %llu, avg %llu ns\n", klife_lat_names[phase],
+			    (unsigned long long)count,
+			    (unsigned long long)(count ? div64_u64 (atomic64_read (&hist->sum_ns), count) : 0));
+
+		for (i = 0; i < KLIFE_LAT_BUCKETS; i++) {
+			n = atomic64_read (&hist->buckets[i]);
+			if (!n)
+				continue;
+			if (i + 1 < KLIFE_LAT_BUCKETS)
+				seq_printf (m, "\t[%llu, %llu)\t%llu\n", i ? 1ULL << i : 0ULL,
+					    1ULL << (i + 1), (unsigned long long)n);
+			else
+				seq_printf (m, "\t[%llu, ...)\t%llu\n", 1ULL << i, (unsigned long long)n);
+		}
+	}
+
+	return 0;
+}
+
+
+static int debug_lat_open (struct inode *inode, struct file *file)
+{
+	struct klife_board *board = inode->i_private;
+	int ret;
+
+	klife_get_board (board);
+	ret = single_open (file, debug_lat_show, board);
+	if (ret)
+		klife_put_board (board);
+	return ret;
+}
+
+
+static int debug_lat_release (struct inode *inode, struct file *file)
+{
+	struct klife_board *board = inode->i_private;
+	int ret;
+
+	ret = single_release (inode, file);
+	klife_put_board (board);
+	return ret;
+}
+
+
+/* Any write resets all histograms of the board */
+static ssize_t debug_lat_write (struct file *file, const char __user *buf, size_t count,
+				loff_t *ppos)
+{
+	struct klife_board *board = ((struct seq_file *)file->private_data)->private;
+	struct klife_lat_hist *hist;
+	unsigned int phase, i;
+
+	for (phase = 0; phase < KLIFE_LAT_PHASES; phase++) {
+		hist = &board->lat[phase];
+		atomic64_set (&hist->count, 0);
+		atomic64_set (&hist->sum_ns, 0);
+		for (i = 0; i < KLIFE_LAT_BUCKETS; i++)
+			atomic64_set (&hist->buckets[i], 0);
+	}
+
+	return count;
+}
+
+
+static const struct file_operations debug_lat_fops = {
+	.owner = THIS_MODULE,
+	.open = debug_lat_open,
+	.read = seq_read,
+	.write = debug_lat_write,
+	.llseek = seq_lseek,
+	.release = debug_lat_release,
+};
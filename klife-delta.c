@@ -0,0 +1,412 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/proc_fs.h>
+#include <linux/uaccess.h>
+
+#include "klife.h"
+
+
+/*
+ * Delta stream of the board. While delta file is open, stepper encodes every generation as
+ * XOR of the old and the new field, with runs of zero words skipped, into the ring of
+ * records. Only tiles changed by the generation are scanned, so on sparse board record is
+ * small and cheap. Format of records is described in klife-uapi.h.
+ */
+
+static unsigned long delta_ring_size = 4 << 20;
+module_param (delta_ring_size, ulong, 0644);
+MODULE_PARM_DESC (delta_ring_size, "Size of delta stream buffer of board in bytes");
+
+
+struct klife_delta {
+	/* Ring of records, head and tail are free-running byte counters protected by lock.
+	 * Producer only appends records at head and never overwrites unread ones, reader only
+	 * consumes them at tail, so records are copied in and out without the lock. */
+	spinlock_t lock;
+	u8 *ring;
+	unsigned long size;
+	unsigned long head, tail;
+
+	/* serializes readers of the file */
+	struct mutex read_mutex;
+
+	/* Following fields are used by producer only, under board's mutex */
+
+	/* record is encoded here before it's stored into ring */
+	u8 *scratch;
+
+	/* mapping header's seq after the last encoded generation. If it differs, field was
+	 * changed not by generation, and XOR with the back buffer is meaningless. */
+	u32 seq;
+	int resync;
+
+	/* records dropped since the last stored one */
+	unsigned int dropped;
+};
+
+
+/* Encoder state */
+struct delta_enc {
+	u8 *p, *end;
+
+	/* current run, NULL if previous word was zero */
+	struct klife_delta_run *run;
+
+	/* index of word after the last encoded one */
+	u64 pos;
+};
+
+
+/*
+ * Append non-zero word with given index, which must be greater than index of the previous
+ * one.
+ *
+ * Return 0 if succeeded, -ENOSPC if encoded record is too large.
+ */
+static inline int enc_word (struct delta_enc *e, u64 index, u64 w)
+{
+	u64 gap = index - e->pos;
+
+	if (!e->run || gap) {
+		/* runs with zero count are used for large gaps */
+		while (unlikely (gap > U32_MAX)) {
+			if (e->p + sizeof (struct klife_delta_run) > e->end)
+				return -ENOSPC;
+			e->run = (struct klife_delta_run*)e->p;
+			e->run->skip = U32_MAX;
+			e->run->count = 0;
+			e->p += sizeof (struct klife_delta_run);
+			gap -= U32_MAX;
+		}
+
+		if (e->p + sizeof (struct klife_delta_run) > e->end)
+			return -ENOSPC;
+		e->run = (struct klife_delta_run*)e->p;
+		e->run->skip = gap;
+		e->run->count = 0;
+		e->p += sizeof (struct klife_delta_run);
+	}
+
+	if (e->p + sizeof (u64) > e->end)
+		return -ENOSPC;
+	*(u64*)e->p = w;
+	e->p += sizeof (u64);
+	e->run->count++;
+	e->pos = index + 1;
+
+	return 0;
+}
+
+
+/*
+ * Encode words of the new field (XOR with the old one if old is not NULL). Words are
+ * taken in linear order, but only from tiles marked in map (all tiles if map is NULL).
+ * Tile is one word wide, so tile column is the same as word column.
+ *
+ * Return 0 if succeeded, -ENOSPC if encoded record is too large.
+ */
+static int encode (struct klife_board *board, struct delta_enc *e, u64 *old, u64 *new,
+		   unsigned long *map)
+{
+	unsigned int tiles = board->field_width >> KLIFE_TILE_SHIFT;
+	unsigned int bands = board->field_height >> KLIFE_TILE_SHIFT;
+	unsigned int ty, tx, y, i;
+	u64 w;
+	int ret;
+
+	for (ty = 0; ty < bands; ty++) {
+		/* skip band without changed tiles at once */
+		if (map && find_next_bit (map, (ty+1) * tiles, ty * tiles) >= (ty+1) * tiles)
+			continue;
+
+		for (y = ty << KLIFE_TILE_SHIFT; y < (ty+1) << KLIFE_TILE_SHIFT; y++) {
+			for (tx = 0; tx < tiles; tx++) {
+				if (map) {
+					i = find_next_bit (map, (ty+1) * tiles, ty * tiles + tx);
+					if (i >= (ty+1) * tiles)
+						break;
+					tx = i - ty * tiles;
+				}
+
+				w = *field_word (board, new, tx, y);
+				if (old)
+					w ^= *field_word (board, old, tx, y);
+				if (!w)
+					continue;
+
+				ret = enc_word (e, (u64)y * tiles + tx, w);
+				if (ret)
+					return ret;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+/* Copy len bytes to ring at free-running offset pos */
+static void ring_put (struct klife_delta *d, unsigned long pos, const void *src, unsigned long len)
+{
+	unsigned long ofs = pos & (d->size - 1);
+	unsigned long part = min (len, d->size - ofs);
+
+	memcpy (d->ring + ofs, src, part);
+	memcpy (d->ring, (const u8*)src + part, len - part);
+}
+
+
+/*
+ * Append record of the generation which is calculated into field_next to delta stream, if
+ * it's open. Board's mutex must be held, tiles_changed must mark tiles which differ in
+ * field and field_next. Ring is never enlarged: if full record of the field can't fit
+ * into it, reader is told to take the field from the mapping by KLIFE_DELTA_RESYNC record.
+ */
+void board_delta_emit (struct klife_board *board, unsigned long long generation)
+{
+	struct klife_delta *d = board->delta;
+	struct klife_delta_header *hdr;
+	struct delta_enc e;
+	unsigned long len, free;
+	int ret, full;
+	u32 flags;
+
+	if (likely (!d))
+		return;
+
+	full = d->resync || board->header->seq != d->seq;
+
+	hdr = (struct klife_delta_header*)d->scratch;
+	e.p = d->scratch + sizeof (*hdr);
+	e.end = d->scratch + d->size;
+	e.run = NULL;
+	e.pos = 0;
+
+	if (full)
+		ret = encode (board, &e, NULL, board->field_next, NULL);
+	else
+		ret = encode (board, &e, board->field, board->field_next, board->tiles_changed);
+
+	/* seq of mapping header after this generation is published */
+	d->seq = board->header->seq + 2;
+
+	flags = full ? KLIFE_DELTA_FULL : 0;
+	if (ret && full) {
+		/* field is larger than the ring, record without data is stored instead */
+		e.p = d->scratch + sizeof (*hdr);
+		flags = KLIFE_DELTA_RESYNC;
+		ret = 0;
+	}
+
+	len = e.p - d->scratch;
+	hdr->generation = generation;
+	hdr->field_side = board->field_width;
+	hdr->flags = flags;
+	hdr->size = len - sizeof (*hdr);
+	hdr->dropped = d->dropped;
+
+	spin_lock (&d->lock);
+	free = d->size - (d->head - d->tail);
+	spin_unlock (&d->lock);
+
+	if (!ret && free >= len) {
+		ring_put (d, d->head, d->scratch, len);
+		smp_wmb ();
+
+		spin_lock (&d->lock);
+		d->head += len;
+		spin_unlock (&d->lock);
+
+		d->dropped = 0;
+		d->resync = 0;
+	}
+	else {
+		/* overrun, reader will get full field in the next record */
+		d->dropped++;
+		d->resync = 1;
+	}
+}
+
+
+static int delta_open (struct inode *inode, struct file *file)
+{
+	struct klife_board *board = PDE (inode)->data;
+	struct klife_delta *d;
+	unsigned long size;
+
+	/* size of record must fit into its header */
+	size = roundup_pow_of_two (clamp (delta_ring_size, PAGE_SIZE, 1UL << 31));
+
+	d = kzalloc (sizeof (struct klife_delta), GFP_KERNEL);
+	if (!d)
+		return -ENOMEM;
+
+	d->ring = vmalloc (size);
+	d->scratch = vmalloc (size);
+	if (!d->ring || !d->scratch) {
+		vfree (d->ring);
+		vfree (d->scratch);
+		kfree (d);
+		return -ENOMEM;
+	}
+
+	spin_lock_init (&d->lock);
+	mutex_init (&d->read_mutex);
+	d->size = size;
+	d->resync = 1;
+
+	mutex_lock (&board->mutex);
+	if (board->delta) {
+		mutex_unlock (&board->mutex);
+		vfree (d->ring);
+		vfree (d->scratch);
+		kfree (d);
+		return -EBUSY;
+	}
+	board->delta = d;
+	mutex_unlock (&board->mutex);
+
+	klife_get_board (board);
+	file->private_data = board;
+
+	return 0;
+}
+
+
+static int delta_release (struct inode *inode, struct file *file)
+{
+	struct klife_board *board = file->private_data;
+	struct klife_delta *d;
+
+	mutex_lock (&board->mutex);
+	d = board->delta;
+	board->delta = NULL;
+	mutex_unlock (&board->mutex);
+
+	vfree (d->ring);
+	vfree (d->scratch);
+	kfree (d);
+
+	klife_put_board (board);
+
+	return 0;
+}
+
+
+static int delta_ready (struct klife_board *board, struct klife_delta *d)
+{
+	int ret;
+
+	spin_lock (&d->lock);
+	ret = d->head != d->tail || board->dead;
+	spin_unlock (&d->lock);
+
+	return ret;
+}
+
+
+/* Copy len bytes from ring at free-running offset pos to user's buffer */
+static int ring_get (struct klife_delta *d, unsigned long pos, void __user *dst, unsigned long len)
+{
+	unsigned long ofs = pos & (d->size - 1);
+	unsigned long part = min (len, d->size - ofs);
+
+	if (copy_to_user (dst, d->ring + ofs, part))
+		return -EFAULT;
+	if (copy_to_user ((u8 __user*)dst + part, d->ring, len - part))
+		return -EFAULT;
+
+	return 0;
+}
+
+
+static ssize_t delta_read (struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct klife_board *board = file->private_data;
+	struct klife_delta *d = board->delta;
+	struct klife_delta_header hdr;
+	unsigned long tail, head, len, ofs, part;
+	size_t done = 0;
+	int ret;
+
+	if (!delta_ready (board, d)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible (board->events_wait, delta_ready (board, d));
+		if (ret)
+			return ret;
+	}
+
+	mutex_lock (&d->read_mutex);
+
+	spin_lock (&d->lock);
+	head = d->head;
+	tail = d->tail;
+	spin_unlock (&d->lock);
+	smp_rmb ();
+
+	while (tail != head) {
+		ofs = tail & (d->size - 1);
+		part = min (sizeof (hdr), d->size - ofs);
+		memcpy (&hdr, d->ring + ofs, part);
+		memcpy ((u8*)&hdr + part, d->ring, sizeof (hdr) - part);
+
+		len = sizeof (hdr) + hdr.size;
+		if (done + len > count)
+			break;
+
+		if (ring_get (d, tail, buf + done, len)) {
+			ret = done ? done : -EFAULT;
+			goto out;
+		}
+
+		tail += len;
+		done += len;
+	}
+
+	/* record must fit into user's buffer */
+	ret = done ? done : (tail != head ? -EINVAL : 0);
+
+out:
+	spin_lock (&d->lock);
+	d->tail = tail;
+	spin_unlock (&d->lock);
+
+	mutex_unlock (&d->read_mutex);
+
+	return ret;
+}
+
+
+static unsigned int delta_poll (struct file *file, poll_table *wait)
+{
+	struct klife_board *board = file->private_data;
+	struct klife_delta *d = board->delta;
+	unsigned int mask = 0;
+
+	poll_wait (file, &board->events_wait, wait);
+
+	spin_lock (&d->lock);
+	if (d->head != d->tail)
+		mask |= POLLIN | POLLRDNORM;
+	if (board->dead)
+		mask |= POLLHUP;
+	spin_unlock (&d->lock);
+
+	return mask;
+}
+
+
+const struct file_operations klife_delta_fops = {
+	.owner = THIS_MODULE,
+	.open = delta_open,
+	.release = delta_release,
+	.read = delta_read,
+	.poll = delta_poll,
+};
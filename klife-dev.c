@@ -0,0 +1,264 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/uaccess.h>
+
+#include "klife.h"
+
+
+/*
+ * Control device /dev/klife. Every ioctl does the same as the corresponding /proc file, but
+ * without text formatting and parsing, so daemon can drive lots of boards cheaply.
+ * Requests are defined in klife-uapi.h.
+ */
+
+static int dev_create (struct klife_ioc_create __user *arg)
+{
+	struct klife_ioc_create req;
+	struct klife_board_opts opts;
+	char *name;
+	int ret;
+
+	if (copy_from_user (&req, arg, sizeof (req)))
+		return -EFAULT;
+
+	if (req.layout > KLIFE_LAYOUT_TILED || req.topology > KLIFE_TOPOLOGY_TORUS)
+		return -EINVAL;
+	opts.layout = req.layout == KLIFE_LAYOUT_TILED ? KBL_TILED : KBL_LINEAR;
+
+	switch (req.topology) {
+	case KLIFE_TOPOLOGY_PLANE:
+		opts.topology = KBT_PLANE;
+		break;
+	case KLIFE_TOPOLOGY_BOUNDED:
+		opts.topology = KBT_BOUNDED;
+		break;
+	default:
+		opts.topology = KBT_TORUS;
+	}
+
+	/* size and topology make sense only together */
+	if (opts.topology == KBT_PLANE ? req.width || req.height : !req.width || !req.height)
+		return -EINVAL;
+	opts.width = req.width;
+	opts.height = req.height;
+
+	req.rule[KLIFE_RULE_LEN - 1] = 0;
+	if (!req.rule[0])
+		klife_rule_conway (&opts.rule);
+	else if (klife_rule_parse (req.rule, &opts.rule))
+		return -EINVAL;
+
+	req.name[KLIFE_NAME_MAX - 1] = 0;
+	name = kstrdup (req.name, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	ret = klife_create_board (name, &opts);
+	if (ret < 0) {
+		kfree (name);
+		return ret;
+	}
+
+	return put_user (ret, &arg->index);
+}
+
+
+static int dev_destroy (__s32 __user *arg)
+{
+	struct klife_board *board;
+	__s32 index;
+	int ret;
+
+	if (get_user (index, arg))
+		return -EFAULT;
+
+	board = klife_find_board (index);
+	if (!board)
+		return -ENOENT;
+
+	ret = klife_delete_board (board);
+	klife_put_board (board);
+
+	return ret;
+}
+
+
+static int dev_set_mode (struct klife_ioc_mode __user *arg)
+{
+	struct klife_ioc_mode req;
+	struct klife_board *board;
+	int ret;
+
+	if (copy_from_user (&req, arg, sizeof (req)))
+		return -EFAULT;
+
+	if (req.mode > KLIFE_MODE_RUN)
+		return -EINVAL;
+
+	board = klife_find_board (req.index);
+	if (!board)
+		return -ENOENT;
+
+	ret = board_set_mode (board, req.mode == KLIFE_MODE_RUN ? KBM_RUN : KBM_STEP);
+	klife_put_board (board);
+
+	return ret;
+}
+
+
+static int dev_step (struct klife_ioc_step __user *arg)
+{
+	struct klife_ioc_step req;
+	struct klife_board *board;
+	int ret;
+
+	if (copy_from_user (&req, arg, sizeof (req)))
+		return -EFAULT;
+
+	board = klife_find_board (req.index);
+	if (!board)
+		return -ENOENT;
+
+	ret = board_step (board, req.gens);
+	klife_put_board (board);
+
+	return ret;
+}
+
+
+static int dev_change (struct klife_ioc_changes __user *arg)
+{
+	struct klife_ioc_changes req;
+	struct klife_cell_change *changes;
+	struct klife_board *board;
+	unsigned long size;
+	int ret;
+
+	if (copy_from_user (&req, arg, sizeof (req)))
+		return -EFAULT;
+
+	if (req.count > KLIFE_CHANGES_MAX)
+		return -E2BIG;
+	if (!req.count)
+		return 0;
+
+	size = req.count * sizeof (struct klife_cell_change);
+	changes = vmalloc (size);
+	if (!changes)
+		return -ENOMEM;
+
+	if (copy_from_user (changes, (void __user *)(unsigned long)req.changes, size)) {
+		vfree (changes);
+		return -EFAULT;
+	}
+
+	board = klife_find_board (req.index);
+	if (!board) {
+		vfree (changes);
+		return -ENOENT;
+	}
+
+	ret = board_apply_changes (board, changes, req.count);
+	klife_put_board (board);
+	vfree (changes);
+
+	return ret;
+}
+
+
+static int dev_stats (struct klife_ioc_stats __user *arg)
+{
+	struct klife_ioc_stats st;
+	struct klife_board *board;
+	unsigned long *live;
+	unsigned int tiles, seq;
+
+	if (get_user (st.index, &arg->index))
+		return -EFAULT;
+
+	board = klife_find_board (st.index);
+	if (!board)
+		return -ENOENT;
+
+	mutex_lock (&board->mutex);
+	st.threads = board->threads;
+	mutex_unlock (&board->mutex);
+
+	rcu_read_lock ();
+	do {
+		seq = board_read_begin (board);
+		tiles = board_tiles (board);
+		live = board->tiles_live;
+		if (board_read_retry (board, seq))
+			continue;
+
+		st.mode = board->mode == KBM_RUN ? KLIFE_MODE_RUN : KLIFE_MODE_STEP;
+		st.layout = board->layout == KBL_TILED ? KLIFE_LAYOUT_TILED : KLIFE_LAYOUT_LINEAR;
+		st.generation = board->generation;
+		st.side = board->side;
+		st.field_side = board->field_width;
+		st.rate = board->rate;
+		st.rate_achieved = board->rate_achieved;
+		st.tiles_active = board->tiles_active;
+		st.tiles_live = live ? bitmap_weight (live, tiles) : 0;
+	} while (board_read_retry (board, seq));
+	rcu_read_unlock ();
+
+	klife_put_board (board);
+
+	return copy_to_user (arg, &st, sizeof (st)) ? -EFAULT : 0;
+}
+
+
+static long klife_dev_ioctl (struct file *file, unsigned int cmd, unsigned long arg)
+{
+	void __user *uarg = (void __user *)arg;
+
+	switch (cmd) {
+	case KLIFE_IOC_CREATE:
+		return dev_create (uarg);
+	case KLIFE_IOC_DESTROY:
+		return dev_destroy (uarg);
+	case KLIFE_IOC_SET_MODE:
+		return dev_set_mode (uarg);
+	case KLIFE_IOC_STEP:
+		return dev_step (uarg);
+	case KLIFE_IOC_CHANGE:
+		return dev_change (uarg);
+	case KLIFE_IOC_STATS:
+		return dev_stats (uarg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+
+static const struct file_operations klife_dev_fops = {
+	.owner = THIS_MODULE,
+	.unlocked_ioctl = klife_dev_ioctl,
+	.compat_ioctl = klife_dev_ioctl,
+};
+
+
+static struct miscdevice klife_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "klife",
+	.fops = &klife_dev_fops,
+};
+
+
+int klife_dev_register (void)
+{
+	return misc_register (&klife_dev);
+}
+
+
+void klife_dev_unregister (void)
+{
+	misc_deregister (&klife_dev);
+}
@@ -0,0 +1,163 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/proc_fs.h>
+#include <linux/uaccess.h>
+
+#include "klife.h"
+
+
+/*
+ * Generation events of the board. Every finished step or jump is recorded into board's
+ * ring by board_generation_done, which wakes up readers. So viewer could sleep in read or
+ * poll until the next frame is ready instead of polling board's files in a loop. Format of
+ * events is described in klife-uapi.h.
+ */
+
+struct events_file {
+	struct klife_board *board;
+
+	/* amount of board's events already returned to reader */
+	u64 seen;
+};
+
+
+static int events_open (struct inode *inode, struct file *file)
+{
+	struct klife_board *board = PDE (inode)->data;
+	struct events_file *ef;
+
+	ef = kmalloc (sizeof (struct events_file), GFP_KERNEL);
+	if (!ef)
+		return -ENOMEM;
+
+	klife_get_board (board);
+	ef->board = board;
+
+	/* only generations finished after open are reported */
+	read_lock (&board->lock);
+	ef->seen = board->events_count;
+	read_unlock (&board->lock);
+
+	file->private_data = ef;
+
+	return 0;
+}
+
+
+static int events_release (struct inode *inode, struct file *file)
+{
+	struct events_file *ef = file->private_data;
+
+	klife_put_board (ef->board);
+	kfree (ef);
+
+	return 0;
+}
+
+
+static int events_ready (struct events_file *ef)
+{
+	struct klife_board *board = ef->board;
+	int ret;
+
+	read_lock (&board->lock);
+	ret = board->events_count != ef->seen || board->dead;
+	read_unlock (&board->lock);
+
+	return ret;
+}
+
+
+static ssize_t events_read (struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct events_file *ef = file->private_data;
+	struct klife_board *board = ef->board;
+	struct klife_event *ev;
+	struct klife_gen_event *gev;
+	unsigned int n, i;
+	u64 seen, avail;
+	int ret;
+
+	n = min_t (size_t, count / sizeof (struct klife_event), KLIFE_EVENTS_RING);
+	if (!n)
+		return -EINVAL;
+
+	if (!events_ready (ef)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible (board->events_wait, events_ready (ef));
+		if (ret)
+			return ret;
+	}
+
+	ev = kmalloc (n * sizeof (struct klife_event), GFP_KERNEL);
+	if (!ev)
+		return -ENOMEM;
+
+	read_lock (&board->lock);
+
+	seen = ef->seen;
+	avail = board->events_count - seen;
+
+	/* reader is too slow, oldest events are overwritten already */
+	if (avail > KLIFE_EVENTS_RING) {
+		seen = board->events_count - KLIFE_EVENTS_RING;
+		avail = KLIFE_EVENTS_RING;
+	}
+
+	n = min_t (u64, n, avail);
+	for (i = 0; i < n; i++, seen++) {
+		gev = &board->events[seen & (KLIFE_EVENTS_RING - 1)];
+		ev[i].generation = gev->generation;
+		ev[i].time_ns = gev->time_ns;
+		ev[i].missed = i ? 0 : seen - ef->seen;
+	}
+
+	read_unlock (&board->lock);
+
+	/* nothing left on deleted board */
+	if (!n)
+		ret = 0;
+	else if (copy_to_user (buf, ev, n * sizeof (struct klife_event)))
+		ret = -EFAULT;
+	else {
+		ef->seen = seen;
+		ret = n * sizeof (struct klife_event);
+	}
+
+	kfree (ev);
+
+	return ret;
+}
+
+
+static unsigned int events_poll (struct file *file, poll_table *wait)
+{
+	struct events_file *ef = file->private_data;
+	struct klife_board *board = ef->board;
+	unsigned int mask = 0;
+
+	poll_wait (file, &board->events_wait, wait);
+
+	read_lock (&board->lock);
+	if (board->events_count != ef->seen)
+		mask |= POLLIN | POLLRDNORM;
+	if (board->dead)
+		mask |= POLLHUP;
+	read_unlock (&board->lock);
+
+	return mask;
+}
+
+
+const struct file_operations klife_events_fops = {
+	.owner = THIS_MODULE,
+	.open = events_open,
+	.release = events_release,
+	.read = events_read,
+	.poll = events_poll,
+};
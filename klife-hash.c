@@ -0,0 +1,882 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/list.h>
+#include <linux/hash.h>
+#include <linux/bitmap.h>
+
+#include "klife.h"
+#include "klife-hash.h"
+
+
+/*
+ * HashLife engine.
+ *
+ * Field is represented by a quadtree, where every node of level L is a square of 2^L cells
+ * made of four nodes of level L-1. Nodes are hash-consed: node with the same quadrants
+ * exists only once, so repeating parts of a pattern share memory and, more important,
+ * share memoized results. Result of node of level L is its centre (node of level L-1)
+ * advanced by 2^(L-2) generations, which is calculated recursively from results of
+ * smaller nodes.
+ *
+ * Leaves are 8x8 blocks of cells packed to u64 row by row, nodes of 16x16 and 32x32 cells
+ * are advanced by a plain bit-parallel simulation when recursion can't be used.
+ *
+ * Every board has its own node cache with limited amount of nodes. When cache is full,
+ * nodes unreachable from the current pattern are collected by mark and sweep.
+ */
+
+#define LEAF_LEVEL 3
+#define MAX_LEVEL (KLIFE_JUMP_MAX + 8)
+
+static unsigned long hashlife_max_nodes = 1 << 20;
+module_param (hashlife_max_nodes, ulong, 0644);
+MODULE_PARM_DESC (hashlife_max_nodes, "Limit of HashLife node cache of one board");
+
+static struct kmem_cache *node_cache;
+
+
+struct hnode {
+	struct hlist_node hash;
+
+	/* nw, ne, sw and se quadrants, unused by leaves */
+	struct hnode *q[4];
+
+	/* cells of leaf */
+	u64 bits;
+
+	/* centre advanced by 2^(level-2) generations and by 2^jexp generations */
+	struct hnode *result;
+	struct hnode *jresult;
+
+	unsigned char level;
+	unsigned char jexp;
+	unsigned char mark;
+};
+
+
+/* node being advanced by successor: its nine subnodes are advanced one by one */
+struct succ_frame {
+	struct hnode *n;
+	struct hnode *c[9];
+	unsigned int j, task;
+};
+
+/* node being loaded from the field: its quadrants are loaded one by one */
+struct load_frame {
+	struct hnode *q[4];
+	unsigned int level, x, y, i;
+};
+
+/* node to visit and its coordinates */
+struct walk_item {
+	struct hnode *n;
+	s64 x, y;
+};
+
+
+struct klife_hashlife {
+	/* rule of the board, results in cache are valid only for it */
+	struct klife_rule rule;
+
+	struct hlist_head *table;
+	unsigned int shift;
+
+	unsigned long nodes;
+	unsigned long max_nodes;
+	unsigned long collections;
+	unsigned long clipped;
+
+	/* empty node of every level */
+	struct hnode *empty[MAX_LEVEL + 1];
+
+	/* current pattern and field coordinates of its top-left corner */
+	struct hnode *root;
+	s64 x, y;
+
+	/* Nodes are walked by explicit stacks, kernel stack is too small for recursion by
+	 * every level. Depth of walks is limited by MAX_LEVEL, stack of nodes to visit gets
+	 * three siblings per level at most. */
+	struct succ_frame succ[MAX_LEVEL];
+	struct load_frame load[MAX_LEVEL];
+	struct walk_item walk[4 * MAX_LEVEL];
+
+	/* cells of the block advanced by direct simulation */
+	u64 rows[1 << (LEAF_LEVEL + 2)];
+};
+
+
+/*
+ * Node cache
+ */
+static inline unsigned long node_key (unsigned int level, struct hnode * const *q, u64 bits)
+{
+	u64 key = bits * 0x9e3779b97f4a7c15ULL + level;
+	unsigned int i;
+
+	if (level > LEAF_LEVEL)
+		for (i = 0; i < 4; i++)
+			key = (key ^ (unsigned long)q[i]) * 0x9e3779b97f4a7c15ULL;
+
+	return key ^ (key >> 29);
+}
+
+
+/*
+ * Find node with given contents in cache or create it. Returns NULL if cache is full or
+ * memory is exhausted.
+ */
+static struct hnode *lookup (struct klife_hashlife *hl, unsigned int level,
+			     struct hnode * const *q, u64 bits)
+{
+	struct hlist_head *head;
+	struct hlist_node *pos;
+	struct hnode *n;
+	unsigned int i;
+
+	head = &hl->table[hash_64 (node_key (level, q, bits), hl->shift)];
+
+	for (pos = head->first; pos; pos = pos->next) {
+		n = hlist_entry (pos, struct hnode, hash);
+		if (n->level != level)
+			continue;
+		if (level == LEAF_LEVEL) {
+			if (n->bits == bits)
+				return n;
+		}
+		else if (n->q[0] == q[0] && n->q[1] == q[1] && n->q[2] == q[2] && n->q[3] == q[3])
+			return n;
+	}
+
+	if (unlikely (hl->nodes >= hl->max_nodes))
+		return NULL;
+
+	n = kmem_cache_zalloc (node_cache, GFP_KERNEL);
+	if (unlikely (!n))
+		return NULL;
+
+	n->level = level;
+	n->bits = bits;
+	if (level > LEAF_LEVEL)
+		for (i = 0; i < 4; i++)
+			n->q[i] = q[i];
+
+	hlist_add_head (&n->hash, head);
+	hl->nodes++;
+
+	return n;
+}
+
+
+static inline struct hnode *get_leaf (struct klife_hashlife *hl, u64 bits)
+{
+	return lookup (hl, LEAF_LEVEL, NULL, bits);
+}
+
+
+static inline struct hnode *get_node (struct klife_hashlife *hl, struct hnode *nw, struct hnode *ne,
+				      struct hnode *sw, struct hnode *se)
+{
+	struct hnode *q[4] = { nw, ne, sw, se };
+
+	if (unlikely (!nw || !ne || !sw || !se))
+		return NULL;
+
+	return lookup (hl, nw->level + 1, q, 0);
+}
+
+
+static void mark_node (struct klife_hashlife *hl, struct hnode *n)
+{
+	struct walk_item *stack = hl->walk;
+	unsigned int i, top = 0;
+	struct hnode *c;
+
+	if (!n || n->mark)
+		return;
+
+	n->mark = 1;
+	stack[top++].n = n;
+
+	while (top) {
+		n = stack[--top].n;
+		if (n->level == LEAF_LEVEL)
+			continue;
+		for (i = 0; i < 4; i++) {
+			c = n->q[i];
+			if (c && !c->mark) {
+				c->mark = 1;
+				stack[top++].n = c;
+			}
+		}
+	}
+}
+
+
+/*
+ * Free all nodes which are not reachable from root or empty nodes. Memoized results
+ * pointing to freed nodes are forgotten.
+ */
+static void collect_garbage (struct klife_hashlife *hl, struct hnode *root)
+{
+	struct hlist_node *pos, *tmp;
+	struct hnode *n;
+	unsigned int i;
+
+	for (i = LEAF_LEVEL; i <= MAX_LEVEL; i++)
+		mark_node (hl, hl->empty[i]);
+	mark_node (hl, root);
+
+	for (i = 0; i < 1U << hl->shift; i++)
+		for (pos = hl->table[i].first; pos; pos = pos->next) {
+			n = hlist_entry (pos, struct hnode, hash);
+			if (!n->mark)
+				continue;
+			if (n->result && !n->result->mark)
+				n->result = NULL;
+			if (n->jresult && !n->jresult->mark)
+				n->jresult = NULL;
+		}
+
+	for (i = 0; i < 1U << hl->shift; i++)
+		for (pos = hl->table[i].first; pos; pos = tmp) {
+			tmp = pos->next;
+			n = hlist_entry (pos, struct hnode, hash);
+			if (n->mark) {
+				n->mark = 0;
+				continue;
+			}
+			hlist_del (&n->hash);
+			kmem_cache_free (node_cache, n);
+			hl->nodes--;
+		}
+
+	hl->collections++;
+}
+
+
+/*
+ * Evolution
+ */
+static void node_to_rows (struct hnode *n, u64 *rows, unsigned int x, unsigned int y)
+{
+	unsigned int half, r;
+
+	if (n->level == LEAF_LEVEL) {
+		for (r = 0; r < 8; r++)
+			rows[y + r] |= ((n->bits >> (r * 8)) & 0xff) << x;
+		return;
+	}
+
+	half = 1 << (n->level - 1);
+	node_to_rows (n->q[0], rows, x, y);
+	node_to_rows (n->q[1], rows, x + half, y);
+	node_to_rows (n->q[2], rows, x, y + half);
+	node_to_rows (n->q[3], rows, x + half, y + half);
+}
+
+
+static struct hnode *rows_to_node (struct klife_hashlife *hl, const u64 *rows, unsigned int level,
+				   unsigned int x, unsigned int y)
+{
+	unsigned int half, r;
+	u64 bits = 0;
+
+	if (level == LEAF_LEVEL) {
+		for (r = 0; r < 8; r++)
+			bits |= ((rows[y + r] >> x) & 0xff) << (r * 8);
+		return get_leaf (hl, bits);
+	}
+
+	half = 1 << (level - 1);
+	return get_node (hl, rows_to_node (hl, rows, level - 1, x, y),
+			 rows_to_node (hl, rows, level - 1, x + half, y),
+			 rows_to_node (hl, rows, level - 1, x, y + half),
+			 rows_to_node (hl, rows, level - 1, x + half, y + half));
+}
+
+
+/*
+ * Advance centre of small node (16x16 or 32x32 cells) by 2^j generations by direct
+ * simulation.
+ */
+static struct hnode *successor_block (struct klife_hashlife *hl, struct hnode *n, unsigned int j)
+{
+	unsigned int side = 1 << n->level;
+
+	memset (hl->rows, 0, sizeof (hl->rows));
+	node_to_rows (n, hl->rows, 0, 0);
+	klife_step_block (&hl->rule, hl->rows, side, 1 << j);
+
+	return rows_to_node (hl, hl->rows, n->level - 1, side / 4, side / 4);
+}
+
+
+static inline void successor_save (struct hnode *n, unsigned int j, struct hnode *r)
+{
+	if (!r)
+		return;
+
+	if (j == n->level - 2)
+		n->result = r;
+	else {
+		n->jresult = r;
+		n->jexp = j;
+	}
+}
+
+
+/*
+ * Find result of node which needs no subnodes to be advanced: empty or memoized one, or
+ * small block. j is limited by level-2 here.
+ *
+ * Returns 1 if result is found (it's NULL if node cache is full), 0 otherwise.
+ */
+static int successor_known (struct klife_hashlife *hl, struct hnode *n, unsigned int *j,
+			    struct hnode **r)
+{
+	unsigned int level = n->level;
+
+	if (n == hl->empty[level]) {
+		*r = hl->empty[level - 1];
+		return 1;
+	}
+
+	if (*j >= level - 2) {
+		*j = level - 2;
+		if (n->result) {
+			*r = n->result;
+			return 1;
+		}
+	}
+	else if (n->jresult && n->jexp == *j) {
+		*r = n->jresult;
+		return 1;
+	}
+
+	if (level == LEAF_LEVEL + 1 || (level == LEAF_LEVEL + 2 && *j < level - 2)) {
+		*r = successor_block (hl, n, *j);
+		successor_save (n, *j, *r);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Subnodes which are advanced again when node is advanced by 2^(level-2): joins of four
+ * advanced subnodes, result replaces the first of them.
+ */
+static const unsigned char succ_joins[4][4] = {
+	{ 0, 1, 3, 4 }, { 1, 2, 4, 5 }, { 3, 4, 6, 7 }, { 4, 5, 7, 8 },
+};
+
+
+/* Start frame of node: nine overlapping subnodes of level-1 */
+static void successor_frame (struct klife_hashlife *hl, struct succ_frame *f,
+			     struct hnode *n, unsigned int j)
+{
+	struct hnode **q = n->q;
+
+	f->n = n;
+	f->j = j;
+	f->task = 0;
+	f->c[0] = q[0];
+	f->c[1] = get_node (hl, q[0]->q[1], q[1]->q[0], q[0]->q[3], q[1]->q[2]);
+	f->c[2] = q[1];
+	f->c[3] = get_node (hl, q[0]->q[2], q[0]->q[3], q[2]->q[0], q[2]->q[1]);
+	f->c[4] = get_node (hl, q[0]->q[3], q[1]->q[2], q[2]->q[1], q[3]->q[0]);
+	f->c[5] = get_node (hl, q[1]->q[2], q[1]->q[3], q[3]->q[0], q[3]->q[1]);
+	f->c[6] = q[2];
+	f->c[7] = get_node (hl, q[2]->q[1], q[3]->q[0], q[2]->q[3], q[3]->q[2]);
+	f->c[8] = q[3];
+}
+
+
+/*
+ * Tasks of frame: nine subnodes are advanced, then (if node is advanced by 2^(level-2))
+ * four joins of them are advanced again.
+ */
+static inline unsigned int successor_tasks (struct succ_frame *f)
+{
+	return f->j == f->n->level - 2 ? 13 : 9;
+}
+
+
+/* Node which is advanced by the current task of frame, NULL if cache is full */
+static inline struct hnode *successor_input (struct klife_hashlife *hl, struct succ_frame *f)
+{
+	const unsigned char *k;
+
+	if (f->task < 9)
+		return f->c[f->task];
+
+	k = succ_joins[f->task - 9];
+	return get_node (hl, f->c[k[0]], f->c[k[1]], f->c[k[2]], f->c[k[3]]);
+}
+
+
+/* Result of the current task is stored and the next one is taken */
+static inline void successor_done (struct succ_frame *f, struct hnode *r)
+{
+	f->c[f->task < 9 ? f->task : succ_joins[f->task - 9][0]] = r;
+	f->task++;
+}
+
+
+/* All tasks of the frame are done, make result of its node */
+static struct hnode *successor_result (struct klife_hashlife *hl, struct succ_frame *f)
+{
+	struct hnode **c = f->c;
+
+	if (f->j < f->n->level - 2)
+		/* subnodes are already advanced, take their centres */
+		return get_node (hl,
+				 get_node (hl, c[0]->q[3], c[1]->q[2], c[3]->q[1], c[4]->q[0]),
+				 get_node (hl, c[1]->q[3], c[2]->q[2], c[4]->q[1], c[5]->q[0]),
+				 get_node (hl, c[3]->q[3], c[4]->q[2], c[6]->q[1], c[7]->q[0]),
+				 get_node (hl, c[4]->q[3], c[5]->q[2], c[7]->q[1], c[8]->q[0]));
+
+	/* subnodes are advanced by half of the time, and their joins again */
+	return get_node (hl, c[0], c[1], c[3], c[4]);
+}
+
+
+/*
+ * Returns centre of node advanced by 2^j generations, j could not be larger than
+ * level-2. Returns NULL if node cache is full.
+ *
+ * Every node is advanced by its subnodes of lower level, nodes waiting for their subnodes
+ * are kept in hl->succ stack, one frame per level.
+ */
+static struct hnode *successor (struct klife_hashlife *hl, struct hnode *n, unsigned int j)
+{
+	struct succ_frame *f;
+	struct hnode *r;
+	unsigned int depth = 0;
+
+	if (successor_known (hl, n, &j, &r))
+		return r;
+	successor_frame (hl, &hl->succ[0], n, j);
+
+	for (;;) {
+		f = &hl->succ[depth];
+
+		if (f->task == successor_tasks (f)) {
+			r = successor_result (hl, f);
+			if (unlikely (!r))
+				return NULL;
+			successor_save (f->n, f->j, r);
+			if (!depth)
+				return r;
+			successor_done (&hl->succ[--depth], r);
+			continue;
+		}
+
+		n = successor_input (hl, f);
+		if (unlikely (!n))
+			return NULL;
+
+		j = f->j;
+		if (successor_known (hl, n, &j, &r)) {
+			if (unlikely (!r))
+				return NULL;
+			successor_done (f, r);
+			continue;
+		}
+
+		/* subnode has lower level, so depth never exceeds amount of levels */
+		successor_frame (hl, &hl->succ[++depth], n, j);
+	}
+}
+
+
+/* Returns node of level+1 with the given node in the centre */
+static struct hnode *centre (struct klife_hashlife *hl, struct hnode *n)
+{
+	struct hnode *e = hl->empty[n->level - 1];
+
+	return get_node (hl, get_node (hl, e, e, e, n->q[0]),
+			 get_node (hl, e, e, n->q[1], e),
+			 get_node (hl, e, n->q[2], e, e),
+			 get_node (hl, n->q[3], e, e, e));
+}
+
+
+/*
+ * Conversion from and to board's field
+ */
+static inline int tile_live (struct klife_board *board, unsigned int tx, unsigned int ty)
+{
+	unsigned int tile = board_tile_index (board, tx, ty);
+
+	return test_bit (tile, board->tiles_live);
+}
+
+
+/*
+ * Node of the field which is loaded without its quadrants: outside of the field, in empty
+ * tile, or leaf.
+ *
+ * Returns 1 if node is found (it's NULL if node cache is full), 0 otherwise.
+ */
+static int load_direct (struct klife_hashlife *hl, struct klife_board *board,
+			unsigned int level, unsigned int x, unsigned int y, struct hnode **n)
+{
+	unsigned int r;
+	u64 bits = 0, word;
+
+	if (x >= board->field_width || y >= board->field_height) {
+		*n = hl->empty[level];
+		return 1;
+	}
+
+	if (level == KLIFE_TILE_SHIFT && !tile_live (board, x >> KLIFE_TILE_SHIFT, y >> KLIFE_TILE_SHIFT)) {
+		*n = hl->empty[level];
+		return 1;
+	}
+
+	if (level == LEAF_LEVEL) {
+		for (r = 0; r < 8; r++) {
+			word = *field_word (board, board->field, x >> KLIFE_WORD_SHIFT, y + r);
+			bits |= ((word >> (x & (KLIFE_WORD_BITS - 1))) & 0xff) << (r * 8);
+		}
+		*n = get_leaf (hl, bits);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Load square of 2^level cells at (0, 0) of the field. Nodes waiting for their quadrants
+ * are kept in hl->load stack, one frame per level.
+ */
+static struct hnode *load_node (struct klife_hashlife *hl, struct klife_board *board,
+				unsigned int level)
+{
+	struct load_frame *f;
+	struct hnode *n;
+	unsigned int depth = 0, half, x, y;
+
+	if (load_direct (hl, board, level, 0, 0, &n))
+		return n;
+
+	f = &hl->load[0];
+	f->level = level;
+	f->x = f->y = f->i = 0;
+
+	for (;;) {
+		f = &hl->load[depth];
+
+		if (f->i == 4) {
+			n = get_node (hl, f->q[0], f->q[1], f->q[2], f->q[3]);
+			if (unlikely (!n))
+				return NULL;
+			if (!depth)
+				return n;
+			f = &hl->load[--depth];
+			f->q[f->i++] = n;
+			continue;
+		}
+
+		half = 1 << (f->level - 1);
+		x = f->x + (f->i & 1) * half;
+		y = f->y + (f->i >> 1) * half;
+
+		if (load_direct (hl, board, f->level - 1, x, y, &n)) {
+			if (unlikely (!n))
+				return NULL;
+			f->q[f->i++] = n;
+			continue;
+		}
+
+		f = &hl->load[++depth];
+		f->level = hl->load[depth - 1].level - 1;
+		f->x = x;
+		f->y = y;
+		f->i = 0;
+	}
+}
+
+
+static void store_node (struct klife_hashlife *hl, struct klife_board *board, u64 *dst,
+			struct hnode *root, s64 x0, s64 y0)
+{
+	struct walk_item *stack = hl->walk;
+	unsigned int r, i, top = 0;
+	struct hnode *n;
+	s64 x, y, half;
+
+	stack[top].n = root;
+	stack[top].x = x0;
+	stack[top++].y = y0;
+
+	while (top) {
+		top--;
+		n = stack[top].n;
+		x = stack[top].x;
+		y = stack[top].y;
+
+		if (n == hl->empty[n->level])
+			continue;
+
+		if (x >= board->field_width || y >= board->field_height ||
+		    x + (1LL << n->level) <= 0 || y + (1LL << n->level) <= 0) {
+			hl->clipped++;
+			continue;
+		}
+
+		if (n->level == LEAF_LEVEL) {
+			/* leaves are aligned by 8 cells, so they are completely inside or outside */
+			if (x < 0 || y < 0) {
+				hl->clipped++;
+				continue;
+			}
+			for (r = 0; r < 8; r++)
+				*field_word (board, dst, x >> KLIFE_WORD_SHIFT, y + r) |=
+					((n->bits >> (r * 8)) & 0xff) << (x & (KLIFE_WORD_BITS - 1));
+			continue;
+		}
+
+		/* quadrants are visited in nw, ne, sw, se order */
+		half = 1LL << (n->level - 1);
+		for (i = 4; i-- > 0; top++) {
+			stack[top].n = n->q[i];
+			stack[top].x = x + (i & 1) * half;
+			stack[top].y = y + (i >> 1) * half;
+		}
+	}
+}
+
+
+static void node_extent (struct klife_hashlife *hl, struct hnode *root, s64 x0, s64 y0, s64 *ext)
+{
+	struct walk_item *stack = hl->walk;
+	unsigned int r, i, rows, top = 0;
+	struct hnode *n;
+	s64 x, y, size, half;
+	u64 cols;
+
+	stack[top].n = root;
+	stack[top].x = x0;
+	stack[top++].y = y0;
+
+	while (top) {
+		top--;
+		n = stack[top].n;
+		x = stack[top].x;
+		y = stack[top].y;
+		size = 1LL << n->level;
+
+		if (n == hl->empty[n->level])
+			continue;
+
+		/* outside of field or can't make extent larger */
+		if (x + size <= 0 || y + size <= 0 || (x + size <= *ext && y + size <= *ext))
+			continue;
+
+		if (n->level == LEAF_LEVEL) {
+			cols = 0;
+			rows = 0;
+			for (r = 0; r < 8; r++)
+				if ((n->bits >> (r * 8)) & 0xff) {
+					cols |= (n->bits >> (r * 8)) & 0xff;
+					rows = r + 1;
+				}
+			if (x >= 0 && y >= 0)
+				*ext = max (*ext, max (x + fls64 (cols), y + (s64)rows));
+			continue;
+		}
+
+		half = size / 2;
+		for (i = 4; i-- > 0; top++) {
+			stack[top].n = n->q[i];
+			stack[top].x = x + (i & 1) * half;
+			stack[top].y = y + (i >> 1) * half;
+		}
+	}
+}
+
+
+/*
+ * Interface
+ */
+int hashlife_init (void)
+{
+	node_cache = kmem_cache_create ("klife_hnode", sizeof (struct hnode), 0, 0, NULL);
+
+	return node_cache ? 0 : -ENOMEM;
+}
+
+
+void hashlife_exit (void)
+{
+	kmem_cache_destroy (node_cache);
+}
+
+
+struct klife_hashlife *hashlife_create (const struct klife_rule *rule)
+{
+	struct klife_hashlife *hl;
+	unsigned int i;
+
+	hl = kzalloc (sizeof (struct klife_hashlife), GFP_KERNEL);
+	if (!hl)
+		return NULL;
+
+	hl->rule = *rule;
+
+	/* about two nodes per bucket when cache is full */
+	hl->max_nodes = max (hashlife_max_nodes, 1024UL);
+	hl->shift = ilog2 (hl->max_nodes) - 1;
+	hl->table = vmalloc (sizeof (struct hlist_head) << hl->shift);
+	if (!hl->table)
+		goto err;
+
+	for (i = 0; i < 1U << hl->shift; i++)
+		INIT_HLIST_HEAD (&hl->table[i]);
+
+	hl->empty[LEAF_LEVEL] = get_leaf (hl, 0);
+	for (i = LEAF_LEVEL + 1; i <= MAX_LEVEL; i++) {
+		hl->empty[i] = get_node (hl, hl->empty[i-1], hl->empty[i-1], hl->empty[i-1], hl->empty[i-1]);
+		if (!hl->empty[i])
+			goto err;
+	}
+
+	return hl;
+err:
+	hashlife_destroy (hl);
+	return NULL;
+}
+
+
+void hashlife_destroy (struct klife_hashlife *hl)
+{
+	struct hlist_node *pos, *tmp;
+	unsigned int i;
+
+	if (!hl)
+		return;
+
+	if (hl->table) {
+		for (i = 0; i < 1U << hl->shift; i++)
+			for (pos = hl->table[i].first; pos; pos = tmp) {
+				tmp = pos->next;
+				kmem_cache_free (node_cache, hlist_entry (pos, struct hnode, hash));
+			}
+		vfree (hl->table);
+	}
+
+	kfree (hl);
+}
+
+
+/*
+ * Convert board's field to quadtree. Board's mutex must be held and field must exist.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int hashlife_load (struct klife_hashlife *hl, struct klife_board *board)
+{
+	unsigned int level = LEAF_LEVEL + 1;
+
+	/* keep previous pattern, there is a good chance it's the same */
+	if (hl->nodes > hl->max_nodes / 2)
+		collect_garbage (hl, hl->root);
+
+	while ((1ULL << level) < max (board->field_width, board->field_height))
+		level++;
+
+	hl->root = load_node (hl, board, level);
+	hl->x = hl->y = 0;
+
+	return hl->root ? 0 : -ENOMEM;
+}
+
+
+/*
+ * Advance loaded pattern by 2^k generations.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int hashlife_advance (struct klife_hashlife *hl, unsigned int k)
+{
+	struct hnode *root = hl->root, *res;
+	unsigned int pad = 0, retry;
+	s64 x = hl->x, y = hl->y;
+
+	if (k > KLIFE_JUMP_MAX)
+		return -EINVAL;
+
+	for (retry = 0; retry < 2; retry++) {
+		/* node must be large enough to be advanced by 2^k, and pattern must be inside
+		 * of central quarter, so nothing could escape from the result */
+		root = hl->root;
+		x = hl->x;
+		y = hl->y;
+		pad = 0;
+
+		while (root && (root->level < k + 2 || pad < 2) && root->level < MAX_LEVEL) {
+			x -= 1LL << (root->level - 1);
+			y -= 1LL << (root->level - 1);
+			if (root->level >= k + 2)
+				pad++;
+			root = centre (hl, root);
+		}
+
+		res = root ? successor (hl, root, k) : NULL;
+		if (res)
+			break;
+
+		/* cache is full, drop everything except the pattern and try again */
+		collect_garbage (hl, hl->root);
+	}
+
+	if (!res)
+		return -ENOMEM;
+
+	hl->x = x + (1LL << (root->level - 2));
+	hl->y = y + (1LL << (root->level - 2));
+	hl->root = res;
+
+	return 0;
+}
+
+
+/*
+ * Returns extent of the current pattern: maximal X or Y of live cells in the field
+ * (non-negative coordinates) plus one.
+ */
+unsigned int hashlife_extent (struct klife_hashlife *hl)
+{
+	s64 ext = 0;
+
+	node_extent (hl, hl->root, hl->x, hl->y, &ext);
+
+	return min_t (s64, ext, UINT_MAX);
+}
+
+
+/*
+ * Write current pattern to dst buffer of board's field, census of the board is not
+ * updated. Cells outside of the field are lost. Board's mutex must be held.
+ */
+void hashlife_store (struct klife_hashlife *hl, struct klife_board *board, u64 *dst)
+{
+	memset (dst, 0, PAGE_SIZE << board->pages_power);
+
+	store_node (hl, board, dst, hl->root, hl->x, hl->y);
+}
+
+
+void hashlife_get_stat (struct klife_hashlife *hl, struct klife_hashlife_stat *stat)
+{
+	stat->nodes = hl ? hl->nodes : 0;
+	stat->max_nodes = hl ? hl->max_nodes : hashlife_max_nodes;
+	stat->collections = hl ? hl->collections : 0;
+	stat->clipped = hl ? hl->clipped : 0;
+}
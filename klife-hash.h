@@ -0,0 +1,31 @@
+#ifndef __KLIFE_HASH_H__
+#define __KLIFE_HASH_H__
+
+#include "klife.h"
+
+/* upper limit of 2^k generations jump */
+#define KLIFE_JUMP_MAX 32
+
+struct klife_hashlife;
+
+/* HashLife statistics, shown in /proc */
+struct klife_hashlife_stat {
+	unsigned long nodes;
+	unsigned long max_nodes;
+	unsigned long collections;
+	unsigned long clipped;
+};
+
+extern int hashlife_init (void);
+extern void hashlife_exit (void);
+
+extern struct klife_hashlife *hashlife_create (const struct klife_rule *rule);
+extern void hashlife_destroy (struct klife_hashlife *hl);
+
+extern int hashlife_load (struct klife_hashlife *hl, struct klife_board *board);
+extern int hashlife_advance (struct klife_hashlife *hl, unsigned int k);
+extern unsigned int hashlife_extent (struct klife_hashlife *hl);
+extern void hashlife_store (struct klife_hashlife *hl, struct klife_board *board, u64 *dst);
+extern void hashlife_get_stat (struct klife_hashlife *hl, struct klife_hashlife_stat *stat);
+
+#endif
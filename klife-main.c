@@ -3,6 +3,7 @@
 
 #include "klife.h"
 #include "klife-proc.h"
+#include "klife-hash.h"
 
 
 struct klife_status klife;
@@ -19,15 +20,51 @@ static int klife_init (void)
 	klife.ticks = 0UL;
 	INIT_LIST_HEAD (&klife.boards);
 
+	klife.wq = alloc_workqueue ("klife", WQ_UNBOUND | WQ_HIGHPRI, 0);
+	if (!klife.wq) {
+		printk (KERN_WARNING "klife module failed to create workqueue\n");
+		return -ENOMEM;
+	}
+
+	if (hashlife_init ()) {
+		printk (KERN_WARNING "klife module failed to create HashLife node cache\n");
+		destroy_workqueue (klife.wq);
+		return -ENOMEM;
+	}
+
+	if (klife_step_select ()) {
+		printk (KERN_WARNING "klife module failed to select step kernels\n");
+		hashlife_exit ();
+		destroy_workqueue (klife.wq);
+		return -EINVAL;
+	}
+
+	klife_debug_init ();
+
 #ifdef CONFIG_PROC_FS
 	if (proc_register (&klife)) {
 		printk (KERN_WARNING "klife module failed to initialize /proc interface\n");
+		klife_debug_exit ();
+		hashlife_exit ();
+		destroy_workqueue (klife.wq);
 		return 1;
 	}
 #else
 	printk (KERN_ERR "klife module needs /proc\n");
+	klife_debug_exit ();
+	hashlife_exit ();
+	destroy_workqueue (klife.wq);
 	return -ENODATA;
 #endif
+
+	if (klife_dev_register ()) {
+		printk (KERN_WARNING "klife module failed to register control device\n");
+		proc_free ();
+		klife_debug_exit ();
+		hashlife_exit ();
+		destroy_workqueue (klife.wq);
+		return -ENODEV;
+	}
 	printk (KERN_INFO "klife module initialized\n");
 	return 0;
 }
@@ -35,27 +72,36 @@ static int klife_init (void)
 
 static void klife_exit (void)
 {
+	klife_dev_unregister ();
 	klife_delete_boards ();
 
 #ifdef CONFIG_PROC_FS
 	proc_free ();
 #endif
+	klife_debug_exit ();
+	hashlife_exit ();
+	destroy_workqueue (klife.wq);
 	printk (KERN_INFO "klife module unloaded\n");
 }
 
 
 static void klife_delete_boards (void)
 {
-	struct list_head *list, *ll;
 	struct klife_board *board;
 
-	write_lock (&klife.lock);
-	// iterate over all boards and free them
-	list_for_each_safe (list, ll, &klife.boards) {
-		board = list_entry (list, struct klife_board, next);
+	// free boards one by one, board deletion could sleep
+	while (1) {
+		read_lock (&klife.lock);
+		if (list_empty (&klife.boards))
+			board = NULL;
+		else
+			board = list_entry (klife.boards.next, struct klife_board, next);
+		read_unlock (&klife.lock);
+
+		if (!board)
+			break;
 		klife_delete_board (board);
 	}
-	write_unlock (&klife.lock);
 }
 
 
@@ -0,0 +1,130 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/proc_fs.h>
+#include <asm/io.h>
+
+#include "klife.h"
+
+
+/*
+ * Mapping of board's field to userspace. Header page and both field buffers are mapped
+ * read-only, so viewer gets generations without any copies. Layout of mapping and reader's
+ * protocol are described in klife-uapi.h.
+ */
+
+/* Every mapping holds reference to the board, so buffers live while they are mapped */
+static void field_vm_open (struct vm_area_struct *vma)
+{
+	struct klife_board *board = vma->vm_private_data;
+
+	klife_get_board (board);
+	atomic_inc (&board->maps);
+}
+
+
+static void field_vm_close (struct vm_area_struct *vma)
+{
+	struct klife_board *board = vma->vm_private_data;
+
+	atomic_dec (&board->maps);
+	klife_put_board (board);
+}
+
+
+static struct vm_operations_struct field_vm_ops = {
+	.open = field_vm_open,
+	.close = field_vm_close,
+};
+
+
+/* Map size bytes of kernel memory at kaddr to addr of user's vma */
+static int map_kernel (struct vm_area_struct *vma, unsigned long addr, void *kaddr, unsigned long size)
+{
+	unsigned long ofs;
+	int ret;
+
+	if (!is_vmalloc_addr (kaddr))
+		return remap_pfn_range (vma, addr, virt_to_phys (kaddr) >> PAGE_SHIFT, size, vma->vm_page_prot);
+
+	/* vmalloc'ed buffer is mapped page by page */
+	for (ofs = 0; ofs < size; ofs += PAGE_SIZE) {
+		ret = remap_pfn_range (vma, addr + ofs, vmalloc_to_pfn ((char*)kaddr + ofs),
+				       PAGE_SIZE, vma->vm_page_prot);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+
+static int field_open (struct inode *inode, struct file *file)
+{
+	struct klife_board *board = PDE (inode)->data;
+
+	klife_get_board (board);
+	file->private_data = board;
+
+	return 0;
+}
+
+
+static int field_release (struct inode *inode, struct file *file)
+{
+	klife_put_board (file->private_data);
+	return 0;
+}
+
+
+static int field_mmap (struct file *file, struct vm_area_struct *vma)
+{
+	struct klife_board *board = file->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned long addr = vma->vm_start, buf_size, len;
+	int i, ret = 0;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	/* buffers can't be reallocated while mutex is held, and not at all after it */
+	mutex_lock (&board->mutex);
+
+	buf_size = board->field ? PAGE_SIZE << board->pages_power : 0;
+	if (size > PAGE_SIZE + 2 * buf_size) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = map_kernel (vma, addr, board->header, PAGE_SIZE);
+	addr += PAGE_SIZE;
+
+	for (i = 0; i < 2 && !ret && addr < vma->vm_end; i++) {
+		len = min (buf_size, vma->vm_end - addr);
+		ret = map_kernel (vma, addr, board->buffers[i], len);
+		addr += len;
+	}
+
+	if (!ret) {
+		vma->vm_ops = &field_vm_ops;
+		vma->vm_private_data = board;
+		field_vm_open (vma);
+	}
+
+out:
+	mutex_unlock (&board->mutex);
+	return ret;
+}
+
+
+const struct file_operations klife_field_fops = {
+	.owner = THIS_MODULE,
+	.open = field_open,
+	.release = field_release,
+	.mmap = field_mmap,
+};
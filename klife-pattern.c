@@ -0,0 +1,255 @@
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/ctype.h>
+#include <linux/vmalloc.h>
+
+#include "klife.h"
+#include "klife-pattern.h"
+
+
+/*
+ * Pattern parsers. Text is parsed twice: first pass finds pattern's bounding box, second
+ * fills the bitmap of this size. Supported formats are RLE (with optional header line
+ * 'x = W, y = H, ...') and Life 1.06 (first line '#Life 1.06', then one 'X Y' pair per
+ * line). Life 1.06 coordinates could be negative, pattern is moved to the origin.
+ */
+
+struct parse_state {
+	struct klife_pattern *pat;
+	unsigned int row_bytes;
+
+	/* bounding box found in the first pass */
+	u64 max_x, max_y;
+
+	/* Life 1.06 pattern's box in its own coordinates */
+	long min_x, min_y;
+};
+
+
+/* Set run of n cells starting at (x, y) */
+static int set_cells (struct parse_state *st, u64 x, u64 y, u64 n)
+{
+	if (!n)
+		return 0;
+
+	if (x + n > UINT_MAX || y >= UINT_MAX)
+		return -EFBIG;
+
+	if (st->pat->bits) {
+		for (; n; n--, x++)
+			st->pat->bits[y * st->row_bytes + (x >> 3)] |= 1 << (x & 7);
+		return 0;
+	}
+
+	st->max_x = max (st->max_x, x + n);
+	st->max_y = max (st->max_y, y + 1);
+
+	/* too big pattern is rejected without parsing the rest */
+	if (DIV_ROUND_UP (st->max_x, 8) * st->max_y > KLIFE_PATTERN_MAX)
+		return -EFBIG;
+
+	return 0;
+}
+
+
+/* Skip till the end of line, returns pointer to the next line */
+static const char *skip_line (const char *p, const char *end)
+{
+	while (p < end && *p != '\n')
+		p++;
+	return p < end ? p + 1 : p;
+}
+
+
+static int parse_rle (const char *p, const char *end, struct parse_state *st)
+{
+	unsigned long n;
+	u64 x = 0, y = 0;
+	char *next;
+	int ret, line_start = 1;
+
+	while (p < end) {
+		if (line_start && (*p == '#' || *p == 'x')) {
+			/* comments and header, header is used only for the box */
+			if (*p == 'x' && !st->pat->bits) {
+				const char *q = p;
+
+				while (q < end && *q != '\n' && !isdigit (*q))
+					q++;
+				st->max_x = max_t (u64, st->max_x, simple_strtoul (q, &next, 10));
+				q = next;
+				while (q < end && *q != '\n' && *q != 'y')
+					q++;
+				while (q < end && *q != '\n' && !isdigit (*q))
+					q++;
+				if (q < end && *q != '\n')
+					st->max_y = max_t (u64, st->max_y, simple_strtoul (q, NULL, 10));
+			}
+			p = skip_line (p, end);
+			continue;
+		}
+
+		line_start = *p == '\n';
+		if (isspace (*p)) {
+			p++;
+			continue;
+		}
+
+		n = 1;
+		if (isdigit (*p)) {
+			n = simple_strtoul (p, &next, 10);
+			p = next;
+			if (p >= end)
+				break;
+		}
+
+		if (n > UINT_MAX)
+			return -EFBIG;
+
+		switch (*p) {
+		case '!':
+			return 0;
+		case '$':
+			y += n;
+			x = 0;
+			break;
+		case 'b':
+		case '.':
+			x += n;
+			break;
+		default:
+			/* 'o' and states of multi-state patterns are alive */
+			if (!isalpha (*p))
+				return -EINVAL;
+			ret = set_cells (st, x, y, n);
+			if (ret)
+				return ret;
+			x += n;
+		}
+		p++;
+	}
+
+	return 0;
+}
+
+
+static int parse_life106 (const char *p, const char *end, struct parse_state *st)
+{
+	long x, y, top_x = LONG_MIN, top_y = LONG_MIN;
+	char *next;
+	int ret;
+
+	while (p < end) {
+		while (p < end && isspace (*p))
+			p++;
+		if (p >= end)
+			break;
+
+		if (*p == '#') {
+			p = skip_line (p, end);
+			continue;
+		}
+
+		x = simple_strtol (p, &next, 10);
+		if (next == p)
+			return -EINVAL;
+		p = next;
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		y = simple_strtol (p, &next, 10);
+		if (next == p)
+			return -EINVAL;
+		p = skip_line (next, end);
+
+		/* pattern's box must fit to the board, so difference of coordinates can't overflow */
+		if (x <= -(long)KLIFE_SIDE_MAX || x >= (long)KLIFE_SIDE_MAX ||
+		    y <= -(long)KLIFE_SIDE_MAX || y >= (long)KLIFE_SIDE_MAX)
+			return -EFBIG;
+
+		if (st->pat->bits) {
+			ret = set_cells (st, x - st->min_x, y - st->min_y, 1);
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		st->min_x = min (st->min_x, x);
+		st->min_y = min (st->min_y, y);
+		top_x = max (top_x, x);
+		top_y = max (top_y, y);
+	}
+
+	/* pattern is moved to the origin */
+	if (!st->pat->bits && top_x != LONG_MIN) {
+		st->max_x = (u64)(top_x - st->min_x) + 1;
+		st->max_y = (u64)(top_y - st->min_y) + 1;
+	}
+
+	return 0;
+}
+
+
+static int parse (const char *data, size_t len, struct parse_state *st)
+{
+	const char *end = data + len;
+
+	if (len >= 10 && !strncmp (data, "#Life 1.06", 10))
+		return parse_life106 (skip_line (data, end), end, st);
+
+	return parse_rle (data, end, st);
+}
+
+
+/*
+ * Parse pattern text into bitmap. Data must be terminated by zero byte (not included in
+ * len).
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int pattern_parse (const char *data, size_t len, struct klife_pattern *pat)
+{
+	struct parse_state st;
+	u64 size;
+	int ret;
+
+	memset (&st, 0, sizeof (st));
+	memset (pat, 0, sizeof (*pat));
+	st.pat = pat;
+	st.min_x = st.min_y = LONG_MAX;
+
+	ret = parse (data, len, &st);
+	if (ret)
+		return ret;
+
+	if (!st.max_x || !st.max_y)
+		return 0;
+
+	if (st.max_x > UINT_MAX || st.max_y > UINT_MAX)
+		return -EFBIG;
+
+	st.row_bytes = DIV_ROUND_UP (st.max_x, 8);
+	size = (u64)st.row_bytes * st.max_y;
+	if (size > KLIFE_PATTERN_MAX)
+		return -EFBIG;
+
+	pat->bits = vmalloc (size);
+	if (!pat->bits)
+		return -ENOMEM;
+	memset (pat->bits, 0, size);
+	pat->w = st.max_x;
+	pat->h = st.max_y;
+
+	ret = parse (data, len, &st);
+	if (ret)
+		pattern_free (pat);
+
+	return ret;
+}
+
+
+void pattern_free (struct klife_pattern *pat)
+{
+	vfree (pat->bits);
+	pat->bits = NULL;
+	pat->w = pat->h = 0;
+}
@@ -0,0 +1,18 @@
+#ifndef __KLIFE_PATTERN_H__
+#define __KLIFE_PATTERN_H__
+
+#include <linux/types.h>
+
+/* upper limit of pattern's text and of its bitmap */
+#define KLIFE_PATTERN_MAX (64 << 20)
+
+/* Pattern parsed into packed rows, in format of board_put_rect */
+struct klife_pattern {
+	unsigned int w, h;
+	u8 *bits;
+};
+
+extern int pattern_parse (const char *data, size_t len, struct klife_pattern *pat);
+extern void pattern_free (struct klife_pattern *pat);
+
+#endif
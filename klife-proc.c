@@ -1,15 +1,29 @@
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/proc_fs.h>
 #include <linux/uaccess.h>
 #include <linux/string.h>
 #include <linux/ctype.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
 
 #include "klife.h"
 #include "klife-proc.h"
+#include "klife-hash.h"
+#include "klife-pattern.h"
 
 static struct proc_dir_entry *root;
 static struct proc_dir_entry *boards;
 
+/* spec and result of the last benchmark, protected by bench_mutex */
+static DEFINE_MUTEX (bench_mutex);
+static struct klife_bench_spec bench_spec;
+static struct klife_bench_result bench_result;
+static int bench_done;
+
 
 static int proc_version_read (char *page, char **start, off_t off,
 			      int count, int *eof, void *data);
@@ -23,12 +37,39 @@ static int proc_create_write (struct file *file, const char __user *buffer,
 static int proc_destroy_write (struct file *file, const char __user *buffer,
 			      unsigned long count, void *data);
 
+static int proc_bench_read (char *page, char **start, off_t off,
+			    int count, int *eof, void *data);
+static int proc_bench_write (struct file *file, const char __user *buffer,
+			     unsigned long count, void *data);
+
 /* board functions */
 static int proc_board_name_read (char *page, char **start, off_t off,
 				 int count, int *eof, void *data);
 
 static int proc_board_mode_read (char *page, char **start, off_t off,
 				 int count, int *eof, void *data);
+static int proc_board_mode_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data);
+
+static int proc_board_rate_read (char *page, char **start, off_t off,
+				 int count, int *eof, void *data);
+static int proc_board_rate_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data);
+
+static int proc_board_threads_read (char *page, char **start, off_t off,
+				    int count, int *eof, void *data);
+static int proc_board_threads_write (struct file *file, const char __user *buffer,
+				     unsigned long count, void *data);
+
+static int proc_board_rule_read (char *page, char **start, off_t off,
+				 int count, int *eof, void *data);
+static int proc_board_rule_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data);
+
+static int proc_board_jump_read (char *page, char **start, off_t off,
+				 int count, int *eof, void *data);
+static int proc_board_jump_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data);
 
 static int proc_board_enabled_read (char *page, char **start, off_t off,
 				    int count, int *eof, void *data);
@@ -36,26 +77,36 @@ static int proc_board_enabled_read (char *page, char **start, off_t off,
 static int proc_board_status_read (char *page, char **start, off_t off,
 				   int count, int *eof, void *data);
 
-static int proc_board_read (char *page, char **start, off_t off,
-			    int count, int *eof, void *data);
-static int proc_board_write (struct file *file, const char __user *buffer,
-			     unsigned long count, void *data);
+static int proc_board_view_read (char *page, char **start, off_t off,
+				 int count, int *eof, void *data);
+static int proc_board_view_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data);
+
+static int proc_board_step_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data);
+
+static const struct file_operations proc_board_fops;
+static const struct file_operations proc_board_raw_fops;
+static const struct file_operations proc_board_import_fops;
 
 
 /* Utility functions */
-typedef enum {
-	REQ_SET,
-	REQ_CLEAR,
-	REQ_TOGGLE,
-} change_request_kind_t;
 
 static char* get_board_index_str (struct klife_board *board);
 
 static inline const char* board_mode_as_string (klife_board_mode_t mode);
 static inline const char* board_enabled_as_string (int enabled);
-
+static inline const char* board_layout_as_string (klife_board_layout_t layout);
+static inline const char* board_topology_as_string (klife_board_topology_t topology);
+static int parse_size (const char *val, unsigned int *width, unsigned int *height);
+static int parse_create_opts (char *name, struct klife_board_opts *opts);
+static int parse_bench_spec (char *buf, struct klife_bench_spec *spec);
+static int parse_view (char *buf, struct klife_box *view, int *rle);
+static void dump_init_chars (void);
+
+static inline int skip_spaces (char **p, const char *max_p);
 static int parse_change_request (char *data, unsigned long max_ofs, unsigned long *ofs,
-				 change_request_kind_t *req, unsigned long *x, unsigned long *y);
+				 struct klife_cell_change *change);
 
 
 /*
@@ -63,7 +114,9 @@ static int parse_change_request (char *data, unsigned long max_ofs, unsigned lon
  */
 int proc_register (struct klife_status *klife)
 {
-	struct proc_dir_entry *version, *status, *create, *destroy;
+	struct proc_dir_entry *version, *status, *bench, *create, *destroy;
+
+	dump_init_chars ();
 
 	root = proc_mkdir (KLIFE_PROC_ROOT, NULL);
 	if (unlikely (!root))
@@ -74,6 +127,14 @@ int proc_register (struct klife_status *klife)
 	status = create_proc_read_entry (KLIFE_PROC_STATUS, 0644, root,
 					 &proc_status_read, klife);
 
+	bench = create_proc_entry (KLIFE_PROC_BENCH, 0644, root);
+	if (likely (bench)) {
+		bench->read_proc = proc_bench_read;
+		bench->write_proc = proc_bench_write;
+	}
+	else
+		goto err;
+
 	boards = proc_mkdir (KLIFE_PROC_BOARDS, root);
 	if (unlikely (!boards))
 		goto err;
@@ -108,6 +169,7 @@ int proc_free ()
 	remove_proc_entry (KLIFE_PROC_BOARDS, root);
 	remove_proc_entry (KLIFE_PROC_VERSION, root);
 	remove_proc_entry (KLIFE_PROC_STATUS, root);
+	remove_proc_entry (KLIFE_PROC_BENCH, root);
 	remove_proc_entry (KLIFE_PROC_ROOT, NULL);
 	return 0;
 }
@@ -150,6 +212,8 @@ static int proc_status_read (char *page, char **start, off_t off,
 		       klife->boards_count, klife->boards_running, klife->ticks);
 	read_unlock (&klife->lock);
 
+	len += klife_step_report (page + len, PAGE_SIZE - len);
+
 	return proc_calc_metrics (page, start, off, count, eof, len);
 }
 
@@ -159,6 +223,7 @@ static int proc_create_write (struct file *file, const char __user *buffer,
 {
 	size_t len;
 	char* name = NULL;
+	struct klife_board_opts opts;
 	int ret;
 
 	if (!count) {
@@ -182,9 +247,16 @@ static int proc_create_write (struct file *file, const char __user *buffer,
 	while (len > 0 && name[len-1] == '\n')
 		len--;
 	name[len] = 0;
+
+	ret = parse_create_opts (name, &opts);
+	if (ret) {
+		kfree (name);
+		return ret;
+	}
+
 	printk (KERN_INFO "Create new board with name '%s'\n", name);
-	ret = klife_create_board (name);
-	if (ret)
+	ret = klife_create_board (name, &opts);
+	if (ret < 0)
 		kfree (name);
 	else
 		ret = count;
@@ -192,10 +264,113 @@ static int proc_create_write (struct file *file, const char __user *buffer,
 }
 
 
+/*
+ * Delete board with given index.
+ */
 static int proc_destroy_write (struct file *file, const char __user *buffer,
 			      unsigned long count, void *data)
 {
-	return count;
+	struct klife_board *board;
+	char k_buf[16];
+	char *p = k_buf;
+	unsigned long len;
+	int ret;
+
+	len = min_t (unsigned long, count, sizeof (k_buf) - 1);
+	if (copy_from_user (k_buf, buffer, len))
+		return -EFAULT;
+	k_buf[len] = 0;
+
+	if (!skip_spaces (&p, k_buf + len) || !isdigit (*p))
+		return -EINVAL;
+
+	board = klife_find_board (simple_strtoul (p, NULL, 10));
+	if (!board)
+		return -ENOENT;
+
+	ret = klife_delete_board (board);
+	klife_put_board (board);
+
+	return ret ? ret : count;
+}
+
+
+/*
+ * Result of the last benchmark, with its spec in the form accepted by write.
+ */
+static int proc_bench_read (char *page, char **start, off_t off,
+			    int count, int *eof, void *data)
+{
+	struct klife_bench_spec *spec = &bench_spec;
+	struct klife_bench_result *res = &bench_result;
+	char rule[KLIFE_RULE_MAX];
+	int len;
+
+	if (mutex_lock_interruptible (&bench_mutex))
+		return -EINTR;
+
+	if (!bench_done) {
+		mutex_unlock (&bench_mutex);
+		len = snprintf (page, count, "No benchmark was run\n");
+		return proc_calc_metrics (page, start, off, count, eof, len);
+	}
+
+	klife_rule_format (&spec->opts.rule, rule, sizeof (rule));
+	len = snprintf (page, count, "Version:\t%d.%d\n"
+			"Spec:\t\tsize=%ux%u layout=%s topology=%s rule=%s density=%u gens=%u "
+			"warmup=%u threads=%u seed=%llu\n"
+			"Step kernels:\t%s\n"
+			"Field:\t\t%ux%u\n"
+			"Per generation:\tavg %llu ns, p50 %llu ns, p99 %llu ns\n"
+			"Rate:\t\t%llu cells/s\n"
+			"Population:\t%llu\n",
+			KLIFE_VER_MAJOR, KLIFE_VER_MINOR,
+			spec->opts.width, spec->opts.height, board_layout_as_string (spec->opts.layout),
+			board_topology_as_string (spec->opts.topology), rule, spec->density,
+			spec->gens, spec->warmup, spec->threads, spec->seed,
+			res->kernel, res->width, res->height,
+			div64_u64 (res->total_ns, spec->gens), res->p50_ns, res->p99_ns,
+			res->cells_rate, res->population);
+	mutex_unlock (&bench_mutex);
+
+	return proc_calc_metrics (page, start, off, count, eof, len);
+}
+
+
+/*
+ * Run benchmark by spec (see parse_bench_spec). Writer waits until it's finished, and
+ * could interrupt it by signal. Only one benchmark runs at a time.
+ */
+static int proc_bench_write (struct file *file, const char __user *buffer,
+			     unsigned long count, void *data)
+{
+	struct klife_bench_spec spec;
+	struct klife_bench_result res;
+	char k_buf[256];
+	unsigned long len;
+	int ret;
+
+	len = min_t (unsigned long, count, sizeof (k_buf) - 1);
+	if (copy_from_user (k_buf, buffer, len))
+		return -EFAULT;
+	k_buf[len] = 0;
+
+	ret = parse_bench_spec (k_buf, &spec);
+	if (ret)
+		return ret;
+
+	if (mutex_lock_interruptible (&bench_mutex))
+		return -EINTR;
+
+	ret = klife_bench_run (&spec, &res);
+	if (!ret) {
+		bench_spec = spec;
+		bench_result = res;
+		bench_done = 1;
+	}
+	mutex_unlock (&bench_mutex);
+
+	return ret ? ret : count;
 }
 
 
@@ -205,60 +380,169 @@ static int proc_destroy_write (struct file *file, const char __user *buffer,
 int proc_create_board (struct klife_board *board)
 {
 	char *name;
-	struct proc_dir_entry *entry = NULL;
+	struct proc_dir_entry *dir, *entry = NULL;
 
 	BUG_ON (!board);
-	write_lock (&board->lock);
 
 	name = get_board_index_str (board);
 	if (unlikely (!name))
-		goto err;
+		return 1;
 
-	board->proc_entry = proc_mkdir (name, boards);
+	dir = proc_mkdir (name, boards);
 	kfree (name);
 
-	if (unlikely (!board->proc_entry))
-		goto err;
+	if (unlikely (!dir))
+		return 1;
 
-	entry = create_proc_read_entry (KLIFE_PROC_BRD_NAME, 0644, board->proc_entry,
+	entry = create_proc_read_entry (KLIFE_PROC_BRD_NAME, 0644, dir,
 					     &proc_board_name_read, board);
 	if (unlikely (!entry))
 		goto err;
 
-	entry = create_proc_read_entry (KLIFE_PROC_BRD_STATUS, 0644, board->proc_entry,
+	entry = create_proc_read_entry (KLIFE_PROC_BRD_STATUS, 0644, dir,
 				&proc_board_status_read, board);
 	if (unlikely (!entry))
 		goto err;
 
-	entry = create_proc_read_entry (KLIFE_PROC_BRD_MODE, 0644, board->proc_entry,
-				       &proc_board_mode_read, board);
-	if (unlikely (!entry))
+	entry = create_proc_entry (KLIFE_PROC_BRD_MODE, 0644, dir);
+
+	if (likely (entry)) {
+		entry->read_proc = proc_board_mode_read;
+		entry->write_proc = proc_board_mode_write;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_RATE, 0644, dir);
+
+	if (likely (entry)) {
+		entry->read_proc = proc_board_rate_read;
+		entry->write_proc = proc_board_rate_write;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_THREADS, 0644, dir);
+
+	if (likely (entry)) {
+		entry->read_proc = proc_board_threads_read;
+		entry->write_proc = proc_board_threads_write;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_RULE, 0644, dir);
+
+	if (likely (entry)) {
+		entry->read_proc = proc_board_rule_read;
+		entry->write_proc = proc_board_rule_write;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_JUMP, 0644, dir);
+
+	if (likely (entry)) {
+		entry->read_proc = proc_board_jump_read;
+		entry->write_proc = proc_board_jump_write;
+		entry->data = board;
+	}
+	else
 		goto err;
 
-	entry = create_proc_read_entry (KLIFE_PROC_BRD_ENABLED, 0644, board->proc_entry,
+	entry = create_proc_read_entry (KLIFE_PROC_BRD_ENABLED, 0644, dir,
 					  &proc_board_enabled_read, board);
 	if (unlikely (!entry))
 		goto err;
 
-	entry = create_proc_entry (KLIFE_PROC_BRD_BOARD, 0644, board->proc_entry);
+	entry = create_proc_entry (KLIFE_PROC_BRD_BOARD, 0644, dir);
+
+	if (likely (entry)) {
+		entry->proc_fops = &proc_board_fops;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_VIEW, 0644, dir);
+
+	if (likely (entry)) {
+		entry->read_proc = proc_board_view_read;
+		entry->write_proc = proc_board_view_write;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_STEP, 0200, dir);
+
+	if (likely (entry)) {
+		entry->write_proc = proc_board_step_write;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_RAW, 0644, dir);
 
 	if (likely (entry)) {
-		entry->write_proc = proc_board_write;
-		entry->read_proc = proc_board_read;
+		entry->proc_fops = &proc_board_raw_fops;
 		entry->data = board;
 	}
 	else
 		goto err;
 
+	entry = create_proc_entry (KLIFE_PROC_BRD_IMPORT, 0200, dir);
+
+	if (likely (entry)) {
+		entry->proc_fops = &proc_board_import_fops;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_FIELD, 0444, dir);
+
+	if (likely (entry)) {
+		entry->proc_fops = &klife_field_fops;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_EVENTS, 0444, dir);
+
+	if (likely (entry)) {
+		entry->proc_fops = &klife_events_fops;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	entry = create_proc_entry (KLIFE_PROC_BRD_DELTA, 0444, dir);
+
+	if (likely (entry)) {
+		entry->proc_fops = &klife_delta_fops;
+		entry->data = board;
+	}
+	else
+		goto err;
+
+	/* creation could sleep, so only the pointer is set under lock */
+	write_lock (&board->lock);
+	board->proc_entry = dir;
 	write_unlock (&board->lock);
 	return 0;
 
 err:
-	/* remove proc entries which was (probably) created */
-	if (board->proc_entry)
-		proc_delete_board (board);
-
-	write_unlock (&board->lock);
+	/* remove proc entries which was (probably) created, board is not visible yet */
+	board->proc_entry = dir;
+	proc_delete_board (board);
+	board->proc_entry = NULL;
 	return 1;
 }
 
@@ -280,14 +564,25 @@ static int proc_board_name_read (char *page, char **start, off_t off,
 }
 
 
-/* Assume that board's spinlock held */
+/* Board's lock must not be held, removal of entries could sleep */
 int proc_delete_board (struct klife_board *board)
 {
 	char* name = get_board_index_str (board);
 
+	remove_proc_entry (KLIFE_PROC_BRD_STEP, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_FIELD, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_EVENTS, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_DELTA, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_RAW, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_IMPORT, board->proc_entry);
 	remove_proc_entry (KLIFE_PROC_BRD_BOARD, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_VIEW, board->proc_entry);
 	remove_proc_entry (KLIFE_PROC_BRD_NAME, board->proc_entry);
 	remove_proc_entry (KLIFE_PROC_BRD_MODE, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_RATE, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_THREADS, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_RULE, board->proc_entry);
+	remove_proc_entry (KLIFE_PROC_BRD_JUMP, board->proc_entry);
 	remove_proc_entry (KLIFE_PROC_BRD_ENABLED, board->proc_entry);
 	remove_proc_entry (KLIFE_PROC_BRD_STATUS, board->proc_entry);
 	remove_proc_entry (name, boards);
@@ -338,173 +633,1321 @@ static int proc_board_mode_read (char *page, char **start, off_t off,
 }
 
 
-
-static int proc_board_enabled_read (char *page, char **start, off_t off,
-				    int count, int *eof, void *data)
+/*
+ * Switch board's mode. Accepts mode name, as it's shown by read.
+ */
+static int proc_board_mode_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data)
 {
 	struct klife_board *board = data;
-	int len;
+	char k_buf[16];
+	unsigned long len;
+	int ret;
 
-	read_lock (&board->lock);
-	len = snprintf (page, count, "%s\n", board_enabled_as_string (board->enabled));
-	read_unlock (&board->lock);
+	len = min_t (unsigned long, count, sizeof (k_buf) - 1);
+	if (copy_from_user (k_buf, buffer, len))
+		return -EFAULT;
+	k_buf[len] = 0;
+	strim (k_buf);
 
-	return proc_calc_metrics (page, start, off, count, eof, len);
+	if (!strcmp (k_buf, board_mode_as_string (KBM_RUN)))
+		ret = board_set_mode (board, KBM_RUN);
+	else if (!strcmp (k_buf, board_mode_as_string (KBM_STEP)))
+		ret = board_set_mode (board, KBM_STEP);
+	else
+		ret = -EINVAL;
+
+	return ret ? ret : count;
 }
 
 
-static int proc_board_status_read (char *page, char **start, off_t off,
-				   int count, int *eof, void *data)
+static int proc_board_rate_read (char *page, char **start, off_t off,
+				 int count, int *eof, void *data)
 {
 	struct klife_board *board = data;
 	int len;
 
 	read_lock (&board->lock);
-	len = snprintf (page, count, "Mode:\t\t%s\nEnabled:\t%s\nSide:\t\t%d\nAlloc side:\t%u\nPages:\t\t%llu\n",
-			board_mode_as_string (board->mode),
-			board->enabled ? "yes" : "no",
-			board->side,
-			board->field_side,
-			board->field ? (1ULL << board->pages_power) : 0);
+	if (board->rate)
+		len = snprintf (page, count, "Target:\t\t%u\n", board->rate);
+	else
+		len = snprintf (page, count, "Target:\t\tmax\n");
+	len += snprintf (page + len, count - len, "Achieved:\t%u\n", board->rate_achieved);
 	read_unlock (&board->lock);
 
 	return proc_calc_metrics (page, start, off, count, eof, len);
 }
 
 
-static int proc_board_read (char *page, char **start, off_t off,
-			    int count, int *eof, void *data)
+/*
+ * Set target rate of the board in generations per second. Zero or 'max' means that board
+ * runs as fast as possible.
+ */
+static int proc_board_rate_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data)
 {
 	struct klife_board *board = data;
-	int x, y;
-	int val;
-	char *p = page;
-
-	*start = p;
+	char k_buf[16];
+	unsigned long len;
+	char *p;
+
+	len = min_t (unsigned long, count, sizeof (k_buf) - 1);
+	if (copy_from_user (k_buf, buffer, len))
+		return -EFAULT;
+	k_buf[len] = 0;
+	p = strim (k_buf);
+
+	if (!strcmp (p, "max"))
+		board_set_rate (board, 0);
+	else if (isdigit (*p))
+		board_set_rate (board, simple_strtoul (p, NULL, 10));
+	else
+		return -EINVAL;
 
-	/* calculate starting point to dump board */
-	x = off % (board->side + 1);
-	y = off / (board->side + 1);
+	return count;
+}
 
-	if (y >= board->side) {
-		*eof = 1;
-		return 0;
-	}
 
-	while (y < board->side) {
-		while (x < board->side) {
-			val = board_get_cell (board, x, y);
-			*p = val ? '#' : '.';
-			p++;
-			x++;
-			count--;
-			if (count <= 0)
-				goto finish;
-		}
 
-		*p = '\n';
-		p++;
-		count--;
-		x = 0;
-		y++;
-		if (count <= 0)
-			goto finish;
-	}
+static int proc_board_threads_read (char *page, char **start, off_t off,
+				    int count, int *eof, void *data)
+{
+	struct klife_board *board = data;
+	int len;
 
-	*eof = 1;
+	mutex_lock (&board->mutex);
+	len = snprintf (page, count, "%u\n", board->threads);
+	mutex_unlock (&board->mutex);
 
-finish:
-	return p - page;
+	return proc_calc_metrics (page, start, off, count, eof, len);
 }
 
 
 /*
- * Routine parses and process change request.
+ * Set amount of workers calculating the board, from 1 to KLIFE_MAX_THREADS.
  */
-static int proc_board_write (struct file *file, const char __user *buffer,
-			     unsigned long count, void *data)
+static int proc_board_threads_write (struct file *file, const char __user *buffer,
+				     unsigned long count, void *data)
 {
 	struct klife_board *board = data;
-	change_request_kind_t req;
-	unsigned long x, y;
-	char *k_buf;
-	unsigned long ofs = 0;
+	char k_buf[16];
+	unsigned long len;
+	int ret;
 
-	k_buf = kmalloc (count, GFP_KERNEL);
+	len = min_t (unsigned long, count, sizeof (k_buf) - 1);
+	if (copy_from_user (k_buf, buffer, len))
+		return -EFAULT;
+	k_buf[len] = 0;
 
-	if (!k_buf)
-		return -ENOMEM;
+	ret = board_set_threads (board, simple_strtoul (k_buf, NULL, 10));
 
-	x = y = 0;
-	req = REQ_SET;
-	count -= copy_from_user (k_buf, buffer, count);
+	return ret ? ret : count;
+}
 
-	while (parse_change_request (k_buf, count, &ofs, &req, &x, &y)) {
-		switch (req) {
-		case REQ_SET:
-			board_set_cell (board, x, y);
-			break;
-		case REQ_CLEAR:
-			board_clear_cell (board, x, y);
-			break;
-		case REQ_TOGGLE:
-			board_toggle_cell (board, x, y);
-			break;
-		}
-	}
 
-	kfree (k_buf);
+static int proc_board_rule_read (char *page, char **start, off_t off,
+				 int count, int *eof, void *data)
+{
+	struct klife_board *board = data;
+	int len;
+
+	mutex_lock (&board->mutex);
+	len = klife_rule_format (&board->rule, page, count);
+	mutex_unlock (&board->mutex);
+	len += snprintf (page + len, count - len, "\n");
 
-	return ofs;
+	return proc_calc_metrics (page, start, off, count, eof, len);
 }
 
 
 /*
- * Utility functions
+ * Set rule of the board in B/S notation, for example B36/S23.
  */
-static inline const char* board_mode_as_string (klife_board_mode_t mode)
+static int proc_board_rule_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data)
 {
-	switch (mode) {
-	case KBM_STEP:
-		return "step";
-	case KBM_RUN:
-		return "run";
-	default:
-		return "unknown";
-	}
-}
+	struct klife_board *board = data;
+	struct klife_rule rule;
+	char k_buf[KLIFE_RULE_MAX];
+	unsigned long len;
+	int ret;
 
+	len = min_t (unsigned long, count, sizeof (k_buf) - 1);
+	if (copy_from_user (k_buf, buffer, len))
+		return -EFAULT;
+	k_buf[len] = 0;
 
-static inline const char* board_enabled_as_string (int enabled)
-{
-	switch (enabled) {
-	case 0:
-		return "0";
-	default:
-		return "1";
-	}
+	ret = klife_rule_parse (strim (k_buf), &rule);
+	if (!ret)
+		ret = board_set_rule (board, &rule);
+
+	return ret ? ret : count;
 }
 
 
-/*
- * Skip spaces in buffer, Returns 1 if faced with non-space character,
- * or 0 if we faced the end of the buffer */
-static inline int skip_spaces (char **p, const char *max_p)
+
+static int proc_board_jump_read (char *page, char **start, off_t off,
+				 int count, int *eof, void *data)
 {
-	while (*p != max_p && isspace (**p)) {
-		++(*p);
-	}
+	struct klife_board *board = data;
+	struct klife_hashlife_stat stat;
+	int len;
 
-	if (*p == max_p)
-		return 0;
-	else
-		return 1;
+	mutex_lock (&board->mutex);
+	hashlife_get_stat (board->hashlife, &stat);
+	mutex_unlock (&board->mutex);
+
+	len = snprintf (page, count, "Nodes:\t\t%lu/%lu\n"
+			"Collections:\t%lu\n"
+			"Clipped:\t%lu\n",
+			stat.nodes, stat.max_nodes, stat.collections, stat.clipped);
+
+	return proc_calc_metrics (page, start, off, count, eof, len);
+}
+
+
+/*
+ * Advance board by 2^k generations by HashLife, k is from 0 to KLIFE_JUMP_MAX.
+ */
+static int proc_board_jump_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data)
+{
+	struct klife_board *board = data;
+	char k_buf[16];
+	char *p = k_buf;
+	unsigned long len;
+	int ret;
+
+	len = min_t (unsigned long, count, sizeof (k_buf) - 1);
+	if (copy_from_user (k_buf, buffer, len))
+		return -EFAULT;
+	k_buf[len] = 0;
+
+	if (!skip_spaces (&p, k_buf + len) || !isdigit (*p))
+		return -EINVAL;
+
+	ret = board_jump (board, simple_strtoul (p, NULL, 10));
+
+	return ret ? ret : count;
+}
+
+
+
+static int proc_board_enabled_read (char *page, char **start, off_t off,
+				    int count, int *eof, void *data)
+{
+	struct klife_board *board = data;
+	int len;
+
+	read_lock (&board->lock);
+	len = snprintf (page, count, "%s\n", board_enabled_as_string (board->enabled));
+	read_unlock (&board->lock);
+
+	return proc_calc_metrics (page, start, off, count, eof, len);
+}
+
+
+static int proc_board_status_read (char *page, char **start, off_t off,
+				   int count, int *eof, void *data)
+{
+	struct klife_board *board = data;
+	char rule[KLIFE_RULE_MAX], box[64], period[64];
+	unsigned long *live;
+	unsigned int tiles, seq;
+	int len;
+
+	klife_rule_format (&board->rule, rule, sizeof (rule));
+
+	/* status is formatted again if field changed meanwhile */
+	rcu_read_lock ();
+	do {
+		seq = board_read_begin (board);
+		tiles = board_tiles (board);
+		live = board->tiles_live;
+
+		/* map must be of the same field as tiles */
+		if (board_read_retry (board, seq))
+			continue;
+
+		if (box_empty (&board->box))
+			snprintf (box, sizeof (box), "none");
+		else
+			snprintf (box, sizeof (box), "%u,%u %ux%u", board->box.x0, board->box.y0,
+				  board->box.x1 - board->box.x0, board->box.y1 - board->box.y0);
+
+		if (board->period)
+			snprintf (period, sizeof (period), "%u (since generation %llu)",
+				  board->period, board->period_gen);
+		else
+			snprintf (period, sizeof (period), "none");
+
+		len = snprintf (page, count, "Mode:\t\t%s\nEnabled:\t%s\nLayout:\t\t%s\nTopology:\t%s\n"
+				"Rule:\t\t%s\nSide:\t\t%d\nAlloc size:\t%ux%u\nPages:\t\t%llu\n"
+				"Generation:\t%llu\nRate:\t\t%u/%u\n"
+				"Population:\t%llu\nBirths:\t\t%llu\nDeaths:\t\t%llu\nBounding box:\t%s\n"
+				"Period:\t\t%s\n"
+				"Tiles:\t\t%u\nActive tiles:\t%u\nLive tiles:\t%u\n"
+				"Memory:\t\t%s\nAlloc time:\t%llu ns\n",
+				board_mode_as_string (board->mode),
+				board->enabled ? "yes" : "no",
+				board_layout_as_string (board->layout),
+				board_topology_as_string (board->topology),
+				rule,
+				board->side,
+				board->field_width, board->field_height,
+				board->field ? (1ULL << board->pages_power) : 0,
+				board->generation,
+				board->rate_achieved, board->rate,
+				board->population, board->births, board->deaths, box, period,
+				tiles, board->tiles_active,
+				live ? bitmap_weight (live, tiles) : 0,
+				board->field_vmapped ? "vmalloc" : "pages",
+				(unsigned long long)board->alloc_ns);
+	} while (board_read_retry (board, seq));
+	rcu_read_unlock ();
+
+	return proc_calc_metrics (page, start, off, count, eof, len);
+}
+
+
+/*
+ * Text dump of the board. File is opened with snapshot of its viewport, so readers get
+ * consistent generation however long they read, and seq_file streams it record by record:
+ * the first record is header (only RLE has it), and the next ones are rows of snapshot.
+ * Text rows are made from table of characters for every byte, so 8 cells are converted at
+ * once. RLE record is a row with following empty rows, which are folded into one "N$".
+ */
+
+/* largest snapshot, the same as of imported pattern */
+#define DUMP_MAX KLIFE_PATTERN_MAX
+
+/* RLE lines are not longer than this, as other programs write */
+#define RLE_LINE 70
+
+struct dump_file {
+	struct klife_board *board;
+	unsigned int x, y, w, h;
+	unsigned int bytes;
+	int rle;
+	struct klife_rule rule;
+	u8 *bits;
+};
+
+/* characters of every byte, cell X is bit X%8 */
+static char dump_chars[256][8];
+
+
+static void dump_init_chars (void)
+{
+	unsigned int b, i;
+
+	for (b = 0; b < 256; b++)
+		for (i = 0; i < 8; i++)
+			dump_chars[b][i] = b & (1 << i) ? '#' : '.';
+}
+
+
+static inline int dump_cell (struct dump_file *dump, const u8 *row, unsigned int x)
+{
+	return (row[x >> 3] >> (x & 7)) & 1;
+}
+
+
+/* Rows of records are given by pointers to their bits, header is SEQ_START_TOKEN */
+static inline u8 *dump_row (struct dump_file *dump, loff_t pos)
+{
+	return dump->bits + (unsigned long)(pos - 1) * dump->bytes;
+}
+
+
+/* Amount of empty rows right after given one */
+static unsigned int dump_empty_after (struct dump_file *dump, unsigned int row)
+{
+	unsigned int r;
+	const u8 *p;
+
+	for (r = row + 1; r < dump->h; r++) {
+		p = dump->bits + (unsigned long)r * dump->bytes;
+		if (p[0] || memcmp (p, p + 1, dump->bytes - 1))
+			break;
+	}
+	return r - row - 1;
+}
+
+
+static void *dump_start (struct seq_file *m, loff_t *pos)
+{
+	struct dump_file *dump = m->private;
+
+	if (!*pos)
+		return SEQ_START_TOKEN;
+	return *pos <= dump->h ? dump_row (dump, *pos) : NULL;
+}
+
+
+static void *dump_next (struct seq_file *m, void *v, loff_t *pos)
+{
+	struct dump_file *dump = m->private;
+
+	/* empty rows are in the record of RLE row before them */
+	if (dump->rle && v != SEQ_START_TOKEN)
+		*pos += dump_empty_after (dump, *pos - 1);
+	(*pos)++;
+
+	return dump_start (m, pos);
+}
+
+
+static void dump_stop (struct seq_file *m, void *v)
+{
+}
+
+
+/* Put RLE item (run or end of row), lines are wrapped by RLE_LINE */
+static void dump_rle_item (struct seq_file *m, unsigned int *col, unsigned int n, char c)
+{
+	char item[16];
+	int len;
+
+	len = n > 1 ? snprintf (item, sizeof (item), "%u%c", n, c) : snprintf (item, sizeof (item), "%c", c);
+	if (*col + len > RLE_LINE) {
+		seq_putc (m, '\n');
+		*col = 0;
+	}
+	seq_write (m, item, len);
+	*col += len;
+}
+
+
+static void dump_rle_row (struct seq_file *m, struct dump_file *dump, const u8 *row,
+			  unsigned int index)
+{
+	unsigned int x = 0, n, col = 0, empty;
+	int val;
+
+	while (x < dump->w) {
+		val = dump_cell (dump, row, x);
+		n = 1;
+		while (x + n < dump->w && dump_cell (dump, row, x + n) == val) {
+			/* whole bytes of the same cells */
+			if (!((x + n) & 7) && x + n + 8 <= dump->w && row[(x + n) >> 3] == (val ? 0xff : 0))
+				n += 8;
+			else
+				n++;
+		}
+
+		/* dead cells at the end of row are not written */
+		if (val || x + n < dump->w)
+			dump_rle_item (m, &col, n, val ? 'o' : 'b');
+		x += n;
+	}
+
+	empty = dump_empty_after (dump, index);
+	if (index + empty + 1 >= dump->h)
+		dump_rle_item (m, &col, 1, '!');
+	else
+		dump_rle_item (m, &col, empty + 1, '$');
+	seq_putc (m, '\n');
+}
+
+
+static int dump_show (struct seq_file *m, void *v)
+{
+	struct dump_file *dump = m->private;
+	const u8 *row = v;
+	unsigned int i, full = dump->w >> 3;
+	char rule[KLIFE_RULE_MAX];
+
+	if (v == SEQ_START_TOKEN) {
+		if (dump->rle) {
+			klife_rule_format (&dump->rule, rule, sizeof (rule));
+			seq_printf (m, "x = %u, y = %u, rule = %s\n", dump->w, dump->h, rule);
+			if (!dump->h)
+				seq_puts (m, "!\n");
+		}
+		return 0;
+	}
+
+	if (dump->rle) {
+		dump_rle_row (m, dump, row, (row - dump->bits) / dump->bytes);
+		return 0;
+	}
+
+	for (i = 0; i < full; i++)
+		seq_write (m, dump_chars[row[i]], 8);
+	if (dump->w & 7)
+		seq_write (m, dump_chars[row[full]], dump->w & 7);
+	seq_putc (m, '\n');
+
+	return 0;
+}
+
+
+static const struct seq_operations dump_seq_ops = {
+	.start = dump_start,
+	.next = dump_next,
+	.stop = dump_stop,
+	.show = dump_show,
+};
+
+
+/*
+ * Viewport is taken from board's view, or it's the whole board: plane is dumped up to its
+ * live area, fixed board is dumped whole. Snapshot isn't made if file is opened only for
+ * write.
+ */
+static int proc_board_open (struct inode *inode, struct file *file)
+{
+	struct klife_board *board = PDE (inode)->data;
+	struct dump_file *dump;
+	ktime_t t0 = ktime_get ();
+	u64 size;
+	int ret;
+
+	dump = kzalloc (sizeof (struct dump_file), GFP_KERNEL);
+	if (!dump)
+		return -ENOMEM;
+	dump->board = board;
+
+	read_lock (&board->lock);
+	if (!box_empty (&board->view)) {
+		dump->x = board->view.x0;
+		dump->y = board->view.y0;
+		dump->w = board->view.x1 - board->view.x0;
+		dump->h = board->view.y1 - board->view.y0;
+	}
+	else if (board->topology == KBT_PLANE)
+		dump->w = dump->h = board->side;
+	else {
+		dump->w = board->field_width;
+		dump->h = board->field_height;
+	}
+	dump->rle = board->view_rle;
+	dump->rule = board->rule;
+	read_unlock (&board->lock);
+
+	if (!dump->w)
+		dump->h = 0;
+	dump->bytes = DIV_ROUND_UP (dump->w, 8);
+
+	if (file->f_mode & FMODE_READ && dump->h) {
+		size = (u64)dump->bytes * dump->h;
+		if (size > DUMP_MAX) {
+			kfree (dump);
+			return -EFBIG;
+		}
+
+		dump->bits = vmalloc (size);
+		if (!dump->bits) {
+			kfree (dump);
+			return -ENOMEM;
+		}
+		board_get_rect (board, dump->x, dump->y, dump->w, dump->h, dump->bits);
+	}
+	else
+		dump->h = 0;
+
+	ret = seq_open (file, &dump_seq_ops);
+	if (ret) {
+		vfree (dump->bits);
+		kfree (dump);
+		return ret;
+	}
+	((struct seq_file *)file->private_data)->private = dump;
+
+	klife_get_board (board);
+	board_lat_add (board, KLIFE_LAT_PROC_READ, t0);
+
+	return 0;
+}
+
+
+static int proc_board_release (struct inode *inode, struct file *file)
+{
+	struct dump_file *dump = ((struct seq_file *)file->private_data)->private;
+
+	klife_put_board (dump->board);
+	vfree (dump->bits);
+	kfree (dump);
+
+	return seq_release (inode, file);
+}
+
+
+/*
+ * Process change requests, see parse_change_request for format. All requests are parsed
+ * first and applied to the board at once, nothing is applied if some of them is invalid.
+ */
+static ssize_t proc_board_write (struct file *file, const char __user *buffer,
+				 size_t count, loff_t *ppos)
+{
+	struct dump_file *dump = ((struct seq_file *)file->private_data)->private;
+	struct klife_board *board = dump->board;
+	struct klife_cell_change *changes, change;
+	unsigned long n = 0, ofs = 0, lines = 1, i;
+	ktime_t t0 = ktime_get ();
+	char *k_buf;
+	int ret;
+
+	k_buf = vmalloc (count + 1);
+	if (!k_buf)
+		return -ENOMEM;
+
+	count -= copy_from_user (k_buf, buffer, count);
+	k_buf[count] = 0;
+
+	/* every request takes its own line */
+	for (i = 0; i < count; i++)
+		if (k_buf[i] == '\n')
+			lines++;
+
+	changes = vmalloc (lines * sizeof (struct klife_cell_change));
+	if (!changes) {
+		vfree (k_buf);
+		return -ENOMEM;
+	}
+
+	for (;;) {
+		ret = parse_change_request (k_buf, count, &ofs, &change);
+		if (ret <= 0)
+			break;
+		if (unlikely (n == lines)) {
+			ret = -EINVAL;
+			break;
+		}
+		changes[n++] = change;
+	}
+
+	if (!ret)
+		ret = board_apply_changes (board, changes, n);
+
+	vfree (changes);
+	vfree (k_buf);
+	board_lat_add (board, KLIFE_LAT_PROC_WRITE, t0);
+
+	return ret ? ret : count;
+}
+
+
+static const struct file_operations proc_board_fops = {
+	.owner = THIS_MODULE,
+	.open = proc_board_open,
+	.release = proc_board_release,
+	.read = seq_read,
+	.write = proc_board_write,
+	.llseek = seq_lseek,
+};
+
+
+/*
+ * Viewport and encoding of board's dump, see parse_view.
+ */
+static int proc_board_view_read (char *page, char **start, off_t off,
+				 int count, int *eof, void *data)
+{
+	struct klife_board *board = data;
+	struct klife_box view;
+	int len, rle;
+
+	read_lock (&board->lock);
+	view = board->view;
+	rle = board->view_rle;
+	read_unlock (&board->lock);
+
+	if (box_empty (&view))
+		len = snprintf (page, count, "all");
+	else
+		len = snprintf (page, count, "%u,%u,%u,%u", view.x0, view.y0,
+				view.x1 - view.x0, view.y1 - view.y0);
+	len += snprintf (page + len, count - len, " %s\n", rle ? "rle" : "text");
+
+	return proc_calc_metrics (page, start, off, count, eof, len);
+}
+
+
+static int proc_board_view_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data)
+{
+	struct klife_board *board = data;
+	struct klife_box view;
+	char k_buf[64];
+	unsigned long len;
+	int ret, rle;
+
+	len = min_t (unsigned long, count, sizeof (k_buf) - 1);
+	if (copy_from_user (k_buf, buffer, len))
+		return -EFAULT;
+	k_buf[len] = 0;
+
+	read_lock (&board->lock);
+	view = board->view;
+	rle = board->view_rle;
+	read_unlock (&board->lock);
+
+	ret = parse_view (k_buf, &view, &rle);
+	if (ret)
+		return ret;
+
+	write_lock (&board->lock);
+	board->view = view;
+	board->view_rle = rle;
+	write_unlock (&board->lock);
+
+	return count;
+}
+
+
+/*
+ * Calculate given amount of generations (one, if nothing is given).
+ */
+static int proc_board_step_write (struct file *file, const char __user *buffer,
+				  unsigned long count, void *data)
+{
+	struct klife_board *board = data;
+	char k_buf[32];
+	unsigned long gens = 1, len;
+	char *p = k_buf;
+	int ret;
+
+	len = min_t (unsigned long, count, sizeof (k_buf) - 1);
+	if (copy_from_user (k_buf, buffer, len))
+		return -EFAULT;
+	k_buf[len] = 0;
+
+	if (skip_spaces (&p, k_buf + len))
+		gens = simple_strtoul (p, NULL, 10);
+
+	ret = board_step (board, gens);
+
+	return ret ? ret : count;
+}
+
+
+/*
+ * Binary interface, see struct klife_raw_header for format. Window of the file is kept in
+ * its private data.
+ */
+
+/* upper limit of data returned by one read */
+#define RAW_READ_MAX (1 << 20)
+
+/* data is copied between user and board by pieces of this size at most */
+#define RAW_CHUNK (64 << 10)
+
+struct raw_file {
+	struct klife_board *board;
+	struct klife_raw_header win;
+};
+
+
+static int proc_board_raw_open (struct inode *inode, struct file *file)
+{
+	struct klife_board *board = PDE (inode)->data;
+	struct raw_file *raw;
+
+	raw = kmalloc (sizeof (struct raw_file), GFP_KERNEL);
+	if (!raw)
+		return -ENOMEM;
+
+	klife_get_board (board);
+	raw->board = board;
+
+	read_lock (&board->lock);
+	raw->win.x = raw->win.y = 0;
+	raw->win.w = board->field_width;
+	raw->win.h = board->field_height;
+	read_unlock (&board->lock);
+
+	file->private_data = raw;
+
+	return 0;
+}
+
+
+static int proc_board_raw_release (struct inode *inode, struct file *file)
+{
+	struct raw_file *raw = file->private_data;
+
+	klife_put_board (raw->board);
+	kfree (raw);
+	return 0;
+}
+
+
+/*
+ * Copy piece of h rows by w cells at (x, y) to buf, every row of piece takes stride bytes.
+ * Only part of the piece inside of the field is taken from the board, the rest is dead.
+ */
+static void raw_get_piece (struct klife_board *board, unsigned int x, unsigned int y,
+			   unsigned int w, unsigned int h, unsigned long stride, u8 *buf)
+{
+	unsigned long fw, fh;
+	unsigned int row;
+
+	read_lock (&board->lock);
+	fw = board->field_width;
+	fh = board->field_height;
+	read_unlock (&board->lock);
+
+	memset (buf, 0, stride * h);
+	if (x >= fw || y >= fh)
+		return;
+
+	w = min_t (unsigned long, w, fw - x);
+	h = min_t (unsigned long, h, fh - y);
+
+	if (DIV_ROUND_UP (w, 8) == stride) {
+		board_get_rect (board, x, y, w, h, buf);
+		return;
+	}
+
+	for (row = 0; row < h; row++)
+		board_get_rect (board, x, y + row, w, 1, buf + row * stride);
+}
+
+
+static ssize_t proc_board_raw_read (struct file *file, char __user *buffer,
+				    size_t count, loff_t *ppos)
+{
+	struct raw_file *raw = file->private_data;
+	struct klife_board *board = raw->board;
+	struct klife_raw_header *win = &raw->win;
+	unsigned long bytes = DIV_ROUND_UP (win->w, 8);
+	unsigned long total = bytes * win->h;
+	unsigned long done, pos, row, b, n, k, len;
+	ktime_t t0 = ktime_get ();
+	u8 *k_buf;
+
+	if (!bytes || *ppos >= total)
+		return 0;
+
+	count = min_t (unsigned long, count, total - *ppos);
+	count = min_t (unsigned long, count, RAW_READ_MAX);
+
+	k_buf = vmalloc (RAW_CHUNK);
+	if (!k_buf)
+		return -ENOMEM;
+
+	/* piece is either a part of one row or a few whole rows */
+	for (done = 0; done < count; done += len) {
+		pos = *ppos + done;
+		row = pos / bytes;
+		b = pos - row * bytes;
+		n = min_t (unsigned long, bytes - b, RAW_CHUNK);
+		k = 1;
+		if (!b && n == bytes)
+			k = min (RAW_CHUNK / bytes, DIV_ROUND_UP (count - done, bytes));
+		len = min (k * n, count - done);
+
+		raw_get_piece (board, win->x + b * 8, win->y + row,
+			       min_t (unsigned long, n * 8, win->w - b * 8), k, n, k_buf);
+
+		if (copy_to_user (buffer + done, k_buf, len)) {
+			vfree (k_buf);
+			return -EFAULT;
+		}
+	}
+
+	vfree (k_buf);
+	*ppos += count;
+	board_lat_add (board, KLIFE_LAT_PROC_READ, t0);
+
+	return count;
+}
+
+
+static ssize_t proc_board_raw_write (struct file *file, const char __user *buffer,
+				     size_t count, loff_t *ppos)
+{
+	struct raw_file *raw = file->private_data;
+	struct klife_board *board = raw->board;
+	struct klife_raw_header *win = &raw->win;
+	struct klife_raw_header hdr;
+	unsigned long bytes, len, rows, n, r0, r1, b0, b1;
+	ktime_t t0 = ktime_get ();
+	u8 *k_buf;
+	int ret = 0;
+
+	if (count < sizeof (hdr))
+		return -EINVAL;
+
+	if (copy_from_user (&hdr, buffer, sizeof (hdr)))
+		return -EFAULT;
+
+	if ((u64)hdr.x + hdr.w > UINT_MAX || (u64)hdr.y + hdr.h > UINT_MAX)
+		return -EINVAL;
+
+	/* only set the window */
+	if (count == sizeof (hdr)) {
+		*win = hdr;
+		*ppos = 0;
+		return count;
+	}
+
+	bytes = DIV_ROUND_UP (hdr.w, 8);
+	len = bytes * hdr.h;
+	if (count - sizeof (hdr) != len)
+		return -EINVAL;
+
+	/* piece is either a part of one row or a few whole rows */
+	n = min_t (unsigned long, bytes, RAW_CHUNK);
+	rows = RAW_CHUNK / n;
+
+	k_buf = vmalloc (min (rows * n, len));
+	if (!k_buf)
+		return -ENOMEM;
+
+	/*
+	 * Pieces are put from the bottom right corner, so the first one enlarges the field to
+	 * the whole rectangle or fails on fixed board before anything is changed.
+	 */
+	for (r1 = hdr.h; r1 > 0 && !ret; r1 = r0) {
+		r0 = r1 - min (rows, r1);
+		for (b1 = bytes; b1 > 0 && !ret; b1 = b0) {
+			b0 = (b1 - 1) / n * n;
+			if (copy_from_user (k_buf, buffer + sizeof (hdr) + r0 * bytes + b0,
+					    (r1 - r0) * (b1 - b0)))
+				ret = -EFAULT;
+			else
+				ret = board_put_rect (board, hdr.x + b0 * 8, hdr.y + r0,
+						      min_t (unsigned long, (b1 - b0) * 8, hdr.w - b0 * 8),
+						      r1 - r0, k_buf);
+		}
+	}
+
+	vfree (k_buf);
+	board_lat_add (board, KLIFE_LAT_PROC_WRITE, t0);
+
+	if (ret)
+		return ret;
+
+	*win = hdr;
+	*ppos = 0;
+
+	return count;
+}
+
+
+static const struct file_operations proc_board_raw_fops = {
+	.owner = THIS_MODULE,
+	.open = proc_board_raw_open,
+	.release = proc_board_raw_release,
+	.read = proc_board_raw_read,
+	.write = proc_board_raw_write,
+	.llseek = default_llseek,
+};
+
+
+
+/*
+ * Pattern import. Text written to the file is collected until it's closed, then the whole
+ * pattern is parsed and placed to the board's origin at once. Errors are returned by
+ * close.
+ */
+struct import_buf {
+	struct klife_board *board;
+	char *data;
+	size_t len, size;
+};
+
+
+static int proc_board_import_open (struct inode *inode, struct file *file)
+{
+	struct import_buf *buf;
+
+	buf = kzalloc (sizeof (struct import_buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	buf->board = PDE (inode)->data;
+	klife_get_board (buf->board);
+	file->private_data = buf;
+
+	return 0;
+}
+
+
+static ssize_t proc_board_import_write (struct file *file, const char __user *buffer,
+					size_t count, loff_t *ppos)
+{
+	struct import_buf *buf = file->private_data;
+	size_t size;
+	char *data;
+
+	if (buf->len + count > KLIFE_PATTERN_MAX)
+		return -EFBIG;
+
+	/* keep space for terminating zero */
+	if (buf->len + count >= buf->size) {
+		size = max_t (size_t, buf->size * 2, buf->len + count + 1);
+		size = max_t (size_t, size, PAGE_SIZE);
+		data = vmalloc (size);
+		if (!data)
+			return -ENOMEM;
+		if (buf->data) {
+			memcpy (data, buf->data, buf->len);
+			vfree (buf->data);
+		}
+		buf->data = data;
+		buf->size = size;
+	}
+
+	if (copy_from_user (buf->data + buf->len, buffer, count))
+		return -EFAULT;
+	buf->len += count;
+
+	return count;
+}
+
+
+static int proc_board_import_flush (struct file *file, fl_owner_t id)
+{
+	struct import_buf *buf = file->private_data;
+	struct klife_pattern pat;
+	int ret;
+
+	if (!buf->len)
+		return 0;
+
+	buf->data[buf->len] = 0;
+	ret = pattern_parse (buf->data, buf->len, &pat);
+	buf->len = 0;
+
+	if (!ret && pat.bits)
+		ret = board_put_rect (buf->board, 0, 0, pat.w, pat.h, pat.bits);
+	pattern_free (&pat);
+
+	return ret;
+}
+
+
+static int proc_board_import_release (struct inode *inode, struct file *file)
+{
+	struct import_buf *buf = file->private_data;
+
+	klife_put_board (buf->board);
+	vfree (buf->data);
+	kfree (buf);
+
+	return 0;
+}
+
+
+static const struct file_operations proc_board_import_fops = {
+	.owner = THIS_MODULE,
+	.open = proc_board_import_open,
+	.write = proc_board_import_write,
+	.flush = proc_board_import_flush,
+	.release = proc_board_import_release,
+};
+
+
+
+/*
+ * Utility functions
+ */
+static inline const char* board_mode_as_string (klife_board_mode_t mode)
+{
+	switch (mode) {
+	case KBM_STEP:
+		return "step";
+	case KBM_RUN:
+		return "run";
+	default:
+		return "unknown";
+	}
+}
+
+
+static inline const char* board_enabled_as_string (int enabled)
+{
+	switch (enabled) {
+	case 0:
+		return "0";
+	default:
+		return "1";
+	}
+}
+
+
+static inline const char* board_layout_as_string (klife_board_layout_t layout)
+{
+	switch (layout) {
+	case KBL_LINEAR:
+		return "linear";
+	case KBL_TILED:
+		return "tiled";
+	default:
+		return "unknown";
+	}
+}
+
+
+static inline const char* board_topology_as_string (klife_board_topology_t topology)
+{
+	switch (topology) {
+	case KBT_PLANE:
+		return "plane";
+	case KBT_BOUNDED:
+		return "bounded";
+	case KBT_TORUS:
+		return "torus";
+	default:
+		return "unknown";
+	}
+}
+
+
+/*
+ * Parse size of fixed board in form WxH.
+ *
+ * Returns 0 if succeeded, -EINVAL otherwise.
+ */
+static int parse_size (const char *val, unsigned int *width, unsigned int *height)
+{
+	unsigned long w, h;
+	char *end;
+
+	if (!isdigit (*val))
+		return -EINVAL;
+	w = simple_strtoul (val, &end, 10);
+	if (*end != 'x' || !isdigit (end[1]))
+		return -EINVAL;
+	h = simple_strtoul (end + 1, &end, 10);
+	if (*end || !w || !h || w > UINT_MAX || h > UINT_MAX)
+		return -EINVAL;
+
+	*width = w;
+	*height = h;
+	return 0;
+}
+
+
+/*
+ * Routine parses board creation request. Request consists of board's name followed by
+ * optional list of key=value options:
+ * 1. layout=linear|tiled
+ * 2. rule=B3/S23 (rule in B/S notation, Conway's one by default)
+ * 3. size=WxH (board of fixed size, multiples of 64, it's infinite plane by default)
+ * 4. topology=bounded|torus (of fixed board, bounded by default)
+ *
+ * Options are stripped from the name, opts are filled with options given or defaults.
+ *
+ * Returns 0 if succeeded, -EINVAL if some option is invalid.
+ */
+static int parse_create_opts (char *name, struct klife_board_opts *opts)
+{
+	char *opt, *val;
+
+	opts->layout = KBL_LINEAR;
+	klife_rule_conway (&opts->rule);
+	opts->topology = KBT_PLANE;
+	opts->width = opts->height = 0;
+
+	while (1) {
+		strim (name);
+		opt = strrchr (name, ' ');
+		opt = opt ? opt + 1 : name;
+
+		val = strchr (opt, '=');
+		if (!val)
+			break;
+		*val++ = 0;
+
+		if (!strcmp (opt, "layout")) {
+			if (!strcmp (val, board_layout_as_string (KBL_LINEAR)))
+				opts->layout = KBL_LINEAR;
+			else if (!strcmp (val, board_layout_as_string (KBL_TILED)))
+				opts->layout = KBL_TILED;
+			else
+				return -EINVAL;
+		}
+		else if (!strcmp (opt, "rule")) {
+			if (klife_rule_parse (val, &opts->rule))
+				return -EINVAL;
+		}
+		else if (!strcmp (opt, "size")) {
+			if (parse_size (val, &opts->width, &opts->height))
+				return -EINVAL;
+		}
+		else if (!strcmp (opt, "topology")) {
+			if (!strcmp (val, board_topology_as_string (KBT_BOUNDED)))
+				opts->topology = KBT_BOUNDED;
+			else if (!strcmp (val, board_topology_as_string (KBT_TORUS)))
+				opts->topology = KBT_TORUS;
+			else
+				return -EINVAL;
+		}
+		else
+			return -EINVAL;
+
+		*opt = 0;
+	}
+
+	/* size and topology make sense only together */
+	if (opts->width && opts->topology == KBT_PLANE)
+		opts->topology = KBT_BOUNDED;
+	if (!opts->width && opts->topology != KBT_PLANE)
+		return -EINVAL;
+
+	return *name ? 0 : -EINVAL;
+}
+
+
+/*
+ * Routine parses benchmark spec, list of key=value options separated by spaces. Options
+ * which are not given have defaults of klife_bench_defaults:
+ * 1. size=WxH (1024x1024)
+ * 2. layout=linear|tiled (linear)
+ * 3. topology=plane|bounded|torus (torus)
+ * 4. rule=B3/S23 (Conway's one)
+ * 5. density=N (35, percents of live cells in soup)
+ * 6. gens=N (1000, measured generations), warmup=N (10)
+ * 7. threads=N (1)
+ * 8. seed=N (1)
+ *
+ * Returns 0 if succeeded, -EINVAL if some option is invalid.
+ */
+static int parse_bench_spec (char *buf, struct klife_bench_spec *spec)
+{
+	char *opt, *val, *end;
+	unsigned long num;
+
+	klife_bench_defaults (spec);
+
+	while ((opt = strsep (&buf, " \t\n")) != NULL) {
+		if (!*opt)
+			continue;
+
+		val = strchr (opt, '=');
+		if (!val)
+			return -EINVAL;
+		*val++ = 0;
+
+		if (!strcmp (opt, "size")) {
+			if (parse_size (val, &spec->opts.width, &spec->opts.height))
+				return -EINVAL;
+			continue;
+		}
+		if (!strcmp (opt, "layout")) {
+			if (!strcmp (val, board_layout_as_string (KBL_LINEAR)))
+				spec->opts.layout = KBL_LINEAR;
+			else if (!strcmp (val, board_layout_as_string (KBL_TILED)))
+				spec->opts.layout = KBL_TILED;
+			else
+				return -EINVAL;
+			continue;
+		}
+		if (!strcmp (opt, "topology")) {
+			if (!strcmp (val, board_topology_as_string (KBT_PLANE)))
+				spec->opts.topology = KBT_PLANE;
+			else if (!strcmp (val, board_topology_as_string (KBT_BOUNDED)))
+				spec->opts.topology = KBT_BOUNDED;
+			else if (!strcmp (val, board_topology_as_string (KBT_TORUS)))
+				spec->opts.topology = KBT_TORUS;
+			else
+				return -EINVAL;
+			continue;
+		}
+		if (!strcmp (opt, "rule")) {
+			if (klife_rule_parse (val, &spec->opts.rule))
+				return -EINVAL;
+			continue;
+		}
+
+		/* the rest are numbers */
+		if (!isdigit (*val))
+			return -EINVAL;
+		num = simple_strtoul (val, &end, 10);
+		if (*end || num > UINT_MAX)
+			return -EINVAL;
+
+		if (!strcmp (opt, "density") && num <= 100)
+			spec->density = num;
+		else if (!strcmp (opt, "gens") && num && num <= KLIFE_BENCH_MAX_GENS)
+			spec->gens = num;
+		else if (!strcmp (opt, "warmup"))
+			spec->warmup = num;
+		else if (!strcmp (opt, "threads") && num && num <= KLIFE_MAX_THREADS)
+			spec->threads = num;
+		else if (!strcmp (opt, "seed"))
+			spec->seed = num;
+		else
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Routine parses view of board's dump, list of words separated by spaces. Words which are
+ * not given keep their current values:
+ * 1. X,Y,W,H - viewport of W x H cells from (X, Y), or "all" for the whole board
+ * 2. text|rle - encoding of cells, text has '#' and '.' characters, one row per line
+ *
+ * Returns 0 if succeeded, -EINVAL if some word is invalid.
+ */
+static int parse_view (char *buf, struct klife_box *view, int *rle)
+{
+	unsigned long v[4];
+	unsigned int i;
+	char *word, *p;
+
+	while ((word = strsep (&buf, " \t\n")) != NULL) {
+		if (!*word)
+			continue;
+
+		if (!strcmp (word, "all")) {
+			box_clear (view);
+			continue;
+		}
+		if (!strcmp (word, "text") || !strcmp (word, "rle")) {
+			*rle = word[0] == 'r';
+			continue;
+		}
+
+		p = word;
+		for (i = 0; i < 4; i++) {
+			if (!isdigit (*p))
+				return -EINVAL;
+			v[i] = simple_strtoul (p, &p, 10);
+			if (*p != (i < 3 ? ',' : 0))
+				return -EINVAL;
+			p++;
+		}
+
+		if (!v[2] || !v[3] || v[0] + v[2] > UINT_MAX || v[1] + v[3] > UINT_MAX)
+			return -EINVAL;
+		view->x0 = v[0];
+		view->y0 = v[1];
+		view->x1 = v[0] + v[2];
+		view->y1 = v[1] + v[3];
+	}
+
+	return 0;
+}
+
+
+/*
+ * Skip spaces in buffer, Returns 1 if faced with non-space character,
+ * or 0 if we faced the end of the buffer */
+static inline int skip_spaces (char **p, const char *max_p)
+{
+	while (*p != max_p && isspace (**p)) {
+		++(*p);
+	}
+
+	if (*p == max_p)
+		return 0;
+	else
+		return 1;
 }
 
 
 /*
  * Routine parses one request at given position of buffer. If request
- * is processed, req structure filled and offset is updated.
+ * is processed, change structure is filled and offset is updated.
  *
  * Every request occupy one line and can have the form:
  * 1. set X Y
@@ -513,47 +1956,61 @@ static inline int skip_spaces (char **p, const char *max_p)
  *
  * Possible return value:
  * 1 - request parsed successfully,
- * 0 - request is invalid and skipped to next line
+ * 0 - there are no more requests in buffer,
+ * -EINVAL - request is invalid
  */
 static int parse_change_request (char *data, unsigned long max_ofs, unsigned long *ofs,
-				 change_request_kind_t *req, unsigned long *x, unsigned long *y)
+				 struct klife_cell_change *change)
 {
 	static const struct {
 		const char* cmd;
-		change_request_kind_t kind;
+		int op;
 	} table[] = {
-		{ .cmd = "set ", .kind = REQ_SET },
-		{ .cmd = "clear ", .kind = REQ_SET },
-		{ .cmd = "toggle ", .kind = REQ_SET },
+		{ .cmd = "set ", .op = KLIFE_CELL_SET },
+		{ .cmd = "clear ", .op = KLIFE_CELL_CLEAR },
+		{ .cmd = "toggle ", .op = KLIFE_CELL_TOGGLE },
 	};
 
-	int ret = 0, i, len;
+	int ret = -EINVAL, i, len;
+	unsigned long x, y;
 	char *p = data + *ofs;
 
 
-	if (!skip_spaces (&p, data + max_ofs))
+	if (!skip_spaces (&p, data + max_ofs)) {
+		ret = 0;
 		goto finish;
+	}
 
-	for (i = 0; i < sizeof(table) / sizeof(table[0]) && !ret; i++) {
+	for (i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
 		len = strlen (table[i].cmd);
-		if (strncmp (p, table[i].cmd, len) == 0) {
-			p += len;
-			if (!skip_spaces (&p, data + max_ofs))
-				goto finish;
+		if (strncmp (p, table[i].cmd, len) == 0)
+			break;
+	}
+	if (i == sizeof(table) / sizeof(table[0]))
+		goto finish;
+	p += len;
 
-			*req = table[i].kind;
-			*x = simple_strtoul (p, &p, 10);
+	/* both coordinates are numbers on the same line */
+	while (*p == ' ' || *p == '\t')
+		p++;
+	if (!isdigit (*p))
+		goto finish;
+	x = simple_strtoul (p, &p, 10);
 
-			if (!skip_spaces (&p, data + max_ofs))
-				goto finish;
+	while (*p == ' ' || *p == '\t')
+		p++;
+	if (!isdigit (*p))
+		goto finish;
+	y = simple_strtoul (p, &p, 10);
 
-			*y = simple_strtoul (p, &p, 10);
-			*ofs = p - data;
+	/* field side could not be larger */
+	if (max (x, y) >= KLIFE_SIDE_MAX)
+		goto finish;
 
-			printk (KERN_INFO "Parsed %s (%lu, %lu)\n", table[i].cmd, *x, *y);
-			ret = 1;
-		}
-	}
+	change->op = table[i].op;
+	change->x = x;
+	change->y = y;
+	ret = 1;
 
  finish:
 	/* search for newline or end of buffer */
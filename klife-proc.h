@@ -6,6 +6,7 @@
 #define KLIFE_PROC_ROOT "klife"
 #define KLIFE_PROC_VERSION "version"
 #define KLIFE_PROC_STATUS "status"
+#define KLIFE_PROC_BENCH "bench"
 #define KLIFE_PROC_BOARDS "boards"
 #define KLIFE_PROC_CREATE "create"
 #define KLIFE_PROC_DESTROY "destroy"
@@ -16,6 +17,17 @@
 #define KLIFE_PROC_BRD_ENABLED "enabled"
 #define KLIFE_PROC_BRD_STATUS "status"
 #define KLIFE_PROC_BRD_BOARD "board"
+#define KLIFE_PROC_BRD_VIEW "view"
+#define KLIFE_PROC_BRD_STEP "step"
+#define KLIFE_PROC_BRD_RATE "rate"
+#define KLIFE_PROC_BRD_THREADS "threads"
+#define KLIFE_PROC_BRD_RULE "rule"
+#define KLIFE_PROC_BRD_JUMP "jump"
+#define KLIFE_PROC_BRD_FIELD "field"
+#define KLIFE_PROC_BRD_RAW "raw"
+#define KLIFE_PROC_BRD_IMPORT "import"
+#define KLIFE_PROC_BRD_EVENTS "events"
+#define KLIFE_PROC_BRD_DELTA "delta"
 
 extern int proc_register (struct klife_status *klife);
 extern int proc_free (void);
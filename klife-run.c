@@ -0,0 +1,236 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/err.h>
+#include <linux/math64.h>
+
+#include "klife.h"
+
+
+/*
+ * Run engine. Every board in KBM_RUN mode has its own kernel thread, which calculates
+ * generations with target rate. Between generations thread sleeps on hrtimer until the
+ * absolute deadline of the next generation, so rate doesn't drift with step duration.
+ *
+ * Periodic pattern doesn't need to be calculated anymore, so when stepper finds a cycle
+ * (see cycle_record), board is paused by its thread, unless autopause is turned off.
+ */
+
+/* serializes mode changes, so thread is never started or stopped twice */
+static DEFINE_MUTEX (run_mutex);
+
+static bool autopause = 1;
+module_param (autopause, bool, 0644);
+MODULE_PARM_DESC (autopause, "Switch running board to step mode when its pattern becomes periodic");
+
+static void set_mode (struct klife_board *board, klife_board_mode_t mode);
+static int board_run_pause (struct klife_board *board, int err, unsigned int period,
+			    unsigned long long period_gen);
+
+/* achieved rate is recalculated once in this interval */
+#define RATE_WINDOW_NS NSEC_PER_SEC
+
+/* interval between tries to pause the board after failed step */
+#define PAUSE_RETRY_NS (10 * NSEC_PER_MSEC)
+
+
+static int board_run_thread (void *data)
+{
+	struct klife_board *board = data;
+	ktime_t deadline, window_start, now, retry;
+	unsigned int rate, period, cur_rate = 0;
+	unsigned long long period_gen, start_gen;
+	unsigned long window_gens = 0;
+	s64 elapsed;
+	int ret;
+
+	deadline = window_start = ktime_get ();
+
+	/* cycle found before start doesn't pause board, user wants it to run anyway */
+	read_lock (&board->lock);
+	start_gen = board->period_gen;
+	read_unlock (&board->lock);
+
+	while (!kthread_should_stop ()) {
+		ret = board_step (board, 1);
+		if (unlikely (ret)) {
+			/* failed step is not repeated, thread only waits to be paused or stopped */
+			while (!board_run_pause (board, ret, 0, 0)) {
+				retry = ktime_set (0, PAUSE_RETRY_NS);
+				set_current_state (TASK_INTERRUPTIBLE);
+				if (kthread_should_stop ()) {
+					__set_current_state (TASK_RUNNING);
+					break;
+				}
+				schedule_hrtimeout (&retry, HRTIMER_MODE_REL);
+				__set_current_state (TASK_RUNNING);
+			}
+			break;
+		}
+		window_gens++;
+
+		now = ktime_get ();
+		elapsed = ktime_to_ns (ktime_sub (now, window_start));
+		if (elapsed >= RATE_WINDOW_NS) {
+			write_lock (&board->lock);
+			board->rate_achieved = div64_u64 (window_gens * NSEC_PER_SEC, elapsed);
+			write_unlock (&board->lock);
+			window_start = now;
+			window_gens = 0;
+		}
+
+		read_lock (&board->lock);
+		rate = board->rate;
+		period = board->period;
+		period_gen = board->period_gen;
+		read_unlock (&board->lock);
+
+		if (period && period_gen != start_gen && autopause &&
+		    board_run_pause (board, 0, period, period_gen))
+			break;
+
+		if (!rate) {
+			/* as fast as possible */
+			cond_resched ();
+			continue;
+		}
+
+		/* rate changed or we are late, start counting deadlines from now */
+		deadline = ktime_add_ns (deadline, div_u64 (NSEC_PER_SEC, rate));
+		if (rate != cur_rate || ktime_to_ns (deadline) < ktime_to_ns (now)) {
+			cur_rate = rate;
+			deadline = ktime_add_ns (now, div_u64 (NSEC_PER_SEC, rate));
+		}
+
+		set_current_state (TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop ())
+			schedule_hrtimeout (&deadline, HRTIMER_MODE_ABS);
+		__set_current_state (TASK_RUNNING);
+	}
+
+	return 0;
+}
+
+
+/*
+ * Switch board to given mode, starting or stopping run thread.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int board_set_mode (struct klife_board *board, klife_board_mode_t mode)
+{
+	struct task_struct *thread;
+	int ret = 0;
+
+	mutex_lock (&run_mutex);
+
+	if (board->mode == mode)
+		goto out;
+
+	if (mode == KBM_RUN && board->dead) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	switch (mode) {
+	case KBM_RUN:
+		thread = kthread_run (board_run_thread, board, "klife/%d", board->index);
+		if (IS_ERR (thread)) {
+			ret = PTR_ERR (thread);
+			goto out;
+		}
+		board->thread = thread;
+		break;
+	case KBM_STEP:
+		kthread_stop (board->thread);
+		board->thread = NULL;
+		break;
+	default:
+		ret = -EINVAL;
+		goto out;
+	}
+
+	set_mode (board, mode);
+
+out:
+	mutex_unlock (&run_mutex);
+	return ret;
+}
+
+
+/* Publish new mode of the board, run_mutex must be held */
+static void set_mode (struct klife_board *board, klife_board_mode_t mode)
+{
+	write_lock (&board->lock);
+	board->mode = mode;
+	board->rate_achieved = 0;
+	write_unlock (&board->lock);
+
+	write_lock (&klife.lock);
+	if (mode == KBM_RUN)
+		klife.boards_running++;
+	else
+		klife.boards_running--;
+	write_unlock (&klife.lock);
+}
+
+
+/*
+ * Switch board to KBM_STEP from its own run thread, which exits right after: pattern is
+ * periodic, or step failed with err (zero if it didn't). Mode change holds run_mutex while
+ * it waits for the thread in kthread_stop, so mutex is only tried, and pause is tried again
+ * after the next generation, or after PAUSE_RETRY_NS if step failed. Board could be
+ * deleted as soon as mutex is released, so thread must not touch it after.
+ *
+ * Returns non-zero if board is paused.
+ */
+static int board_run_pause (struct klife_board *board, int err, unsigned int period,
+			    unsigned long long period_gen)
+{
+	if (!mutex_trylock (&run_mutex))
+		return 0;
+
+	if (err)
+		printk (KERN_INFO "klife: board %d is paused, step failed with error %d\n",
+			board->index, err);
+	else
+		printk (KERN_INFO "klife: board %d is paused, period %u found at generation %llu\n",
+			board->index, period, period_gen);
+
+	board->thread = NULL;
+	set_mode (board, KBM_STEP);
+	mutex_unlock (&run_mutex);
+	return 1;
+}
+
+
+/*
+ * Set target generation rate of the board (generations per second). Zero means that
+ * board runs as fast as possible.
+ */
+void board_set_rate (struct klife_board *board, unsigned int rate)
+{
+	write_lock (&board->lock);
+	board->rate = rate;
+	write_unlock (&board->lock);
+
+	/* wake up thread, so it will not sleep by old rate */
+	mutex_lock (&run_mutex);
+	if (board->thread)
+		wake_up_process (board->thread);
+	mutex_unlock (&run_mutex);
+}
+
+
+/*
+ * Stop run thread of the board which is being deleted. Board is marked dead already, so
+ * thread could not be started again after this.
+ */
+void board_stop (struct klife_board *board)
+{
+	board_set_mode (board, KBM_STEP);
+}
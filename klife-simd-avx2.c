@@ -0,0 +1,7 @@
+/*
+ * AVX2 step kernels, 256 cells per instruction. Compiled with AVX2 enabled, see Makefile.
+ */
+#define SIMD_WORDS 4
+#define SIMD_FN(name) klife_avx2_##name
+
+#include "klife-simd.h"
@@ -0,0 +1,7 @@
+/*
+ * AVX-512 step kernels, 512 cells per instruction. Compiled with AVX-512 enabled, see Makefile.
+ */
+#define SIMD_WORDS 8
+#define SIMD_FN(name) klife_avx512_##name
+
+#include "klife-simd.h"
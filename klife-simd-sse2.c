@@ -0,0 +1,7 @@
+/*
+ * SSE2 step kernels, 128 cells per instruction. Compiled with SSE2 enabled, see Makefile.
+ */
+#define SIMD_WORDS 2
+#define SIMD_FN(name) klife_sse2_##name
+
+#include "klife-simd.h"
@@ -0,0 +1,286 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/preempt.h>
+
+#ifdef CONFIG_X86
+#include <asm/cpufeature.h>
+#include <asm/i387.h>
+#include <asm/xcr.h>
+#else
+/* there are no vector kernels, so these are never called */
+static inline void kernel_fpu_begin (void) {}
+static inline void kernel_fpu_end (void) {}
+#endif
+
+#include "klife-step.h"
+
+
+/*
+ * Selection of step kernels implementation.
+ *
+ * Vector kernels are built only if compiler supports their instruction set (see Makefile),
+ * and used only if CPU supports it and kernel saves its registers on context switch. Like
+ * RAID6 does, every usable implementation is measured at module load, and the fastest one
+ * is used by all boards.
+ *
+ * Kernel code could use vector registers only inside kernel_fpu_begin/end, which disables
+ * preemption. So steppers call kernels by small chunks (KLIFE_STEP_CHUNK), each of them is
+ * bracketed by klife_step_begin/end.
+ */
+
+
+static char *step_kernel;
+module_param (step_kernel, charp, 0444);
+MODULE_PARM_DESC (step_kernel, "Step kernels to use instead of the fastest one: u64, sse2, avx2 or avx512");
+
+
+/* size of benchmark band, it fits into L1 cache with results */
+#define BENCH_ROWS	KLIFE_TILE_WORDS
+#define BENCH_WORDS	16
+
+/* time of measurement of every kernel */
+#define BENCH_NSEC	(2 * NSEC_PER_MSEC)
+
+
+static int usable_always (void)
+{
+	return 1;
+}
+
+
+#ifdef CONFIG_X86
+/* CPU has the feature, and kernel saves registers of given xsave states */
+static int usable_x86 (int feature, u64 states)
+{
+	if (!boot_cpu_has (feature))
+		return 0;
+	if (states && (!boot_cpu_has (X86_FEATURE_OSXSAVE) ||
+		       (xgetbv (XCR_XFEATURE_ENABLED_MASK) & states) != states))
+		return 0;
+	return 1;
+}
+#endif
+
+
+#define DECLARE_SIMD(isa)								\
+	extern void klife_##isa##_step_band (const struct klife_rule *rule, const u64 *up,	\
+					     const u64 *src, const u64 *down, u64 *out,	\
+					     unsigned int rows, unsigned int from,		\
+					     unsigned int to, unsigned int words, int wrap,	\
+					     struct klife_step_stat *stat);			\
+	extern void klife_##isa##_step_tile (const struct klife_rule *rule,		\
+					     const u64 * const tiles[9], u64 *out,		\
+					     struct klife_step_stat *stat)
+
+#define SIMD_IMPL(isa)						\
+	{							\
+		.name = #isa,					\
+		.usable = usable_##isa,				\
+		.fpu = 1,					\
+		.step_band = klife_##isa##_step_band,		\
+		.step_tile = klife_##isa##_step_tile,		\
+	}
+
+
+#ifdef KLIFE_SIMD_SSE2
+DECLARE_SIMD (sse2);
+
+static int usable_sse2 (void)
+{
+	return usable_x86 (X86_FEATURE_XMM2, 0);
+}
+#endif
+
+#if defined (KLIFE_SIMD_AVX2) && defined (X86_FEATURE_AVX2)
+DECLARE_SIMD (avx2);
+
+static int usable_avx2 (void)
+{
+	return usable_x86 (X86_FEATURE_AVX2, 0x6);
+}
+#else
+#undef KLIFE_SIMD_AVX2
+#endif
+
+#if defined (KLIFE_SIMD_AVX512) && defined (X86_FEATURE_AVX512F)
+DECLARE_SIMD (avx512);
+
+static int usable_avx512 (void)
+{
+	return usable_x86 (X86_FEATURE_AVX512F, 0xe6);
+}
+#else
+#undef KLIFE_SIMD_AVX512
+#endif
+
+
+/* in order of preference, when rates are equal */
+static struct klife_step_impl step_impls[] = {
+#ifdef KLIFE_SIMD_AVX512
+	SIMD_IMPL (avx512),
+#endif
+#ifdef KLIFE_SIMD_AVX2
+	SIMD_IMPL (avx2),
+#endif
+#ifdef KLIFE_SIMD_SSE2
+	SIMD_IMPL (sse2),
+#endif
+	{
+		.name = "u64",
+		.usable = usable_always,
+		.fpu = 0,
+		.step_band = klife_step_band_u64,
+		.step_tile = klife_step_tile_u64,
+	},
+};
+
+#define STEP_IMPLS ARRAY_SIZE (step_impls)
+
+/* portable implementation is used until selection */
+struct klife_step_impl *klife_step_impl = &step_impls[STEP_IMPLS - 1];
+
+
+/*
+ * Measure cells per second of band and tile kernels of implementation, on random soup of
+ * Conway's rule. Tiles are taken from the same buffer as the band.
+ */
+static void step_bench (struct klife_step_impl *impl, const struct klife_rule *rule,
+			const u64 *src, u64 *out, struct klife_step_stat *stat)
+{
+	const u64 *tiles[9];
+	u64 cells, ns;
+	ktime_t start;
+	unsigned int i;
+
+	for (i = 0; i < 9; i++)
+		tiles[i] = src + (i % 3) * KLIFE_TILE_WORDS + (i / 3) * 2;
+
+	cells = 0;
+	start = ktime_get ();
+	do {
+		if (impl->fpu)
+			kernel_fpu_begin ();
+		impl->step_band (rule, NULL, src, NULL, out, BENCH_ROWS, 0, BENCH_WORDS,
+				 BENCH_WORDS, 0, stat);
+		if (impl->fpu)
+			kernel_fpu_end ();
+		cells += BENCH_ROWS * BENCH_WORDS * KLIFE_WORD_BITS;
+		ns = ktime_to_ns (ktime_sub (ktime_get (), start));
+	} while (ns < BENCH_NSEC);
+	impl->band_rate = div64_u64 (cells * NSEC_PER_SEC, ns);
+
+	cells = 0;
+	start = ktime_get ();
+	do {
+		if (impl->fpu)
+			kernel_fpu_begin ();
+		for (i = 0; i < KLIFE_STEP_CHUNK; i++)
+			impl->step_tile (rule, tiles, out + (i & 3) * KLIFE_TILE_WORDS, stat);
+		if (impl->fpu)
+			kernel_fpu_end ();
+		cells += KLIFE_STEP_CHUNK * KLIFE_TILE_WORDS * KLIFE_WORD_BITS;
+		ns = ktime_to_ns (ktime_sub (ktime_get (), start));
+	} while (ns < BENCH_NSEC);
+	impl->tile_rate = div64_u64 (cells * NSEC_PER_SEC, ns);
+}
+
+
+/*
+ * Select implementation of step kernels: given by step_kernel parameter, or the fastest
+ * one. Must be called before any board is created.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int klife_step_select (void)
+{
+	struct klife_step_impl *impl, *best = NULL;
+	struct klife_step_stat *stat;
+	struct klife_rule rule;
+	u64 *src, *out;
+	unsigned int i;
+
+	src = kmalloc (2 * BENCH_ROWS * BENCH_WORDS * sizeof (u64), GFP_KERNEL);
+	stat = kzalloc (BENCH_WORDS * sizeof (struct klife_step_stat), GFP_KERNEL);
+	if (!src || !stat) {
+		kfree (src);
+		kfree (stat);
+		return -ENOMEM;
+	}
+	out = src + BENCH_ROWS * BENCH_WORDS;
+	get_random_bytes (src, BENCH_ROWS * BENCH_WORDS * sizeof (u64));
+	klife_rule_conway (&rule);
+
+	for (i = 0; i < STEP_IMPLS; i++) {
+		impl = &step_impls[i];
+		if (!impl->usable ())
+			continue;
+		if (step_kernel && strcmp (step_kernel, impl->name))
+			continue;
+
+		preempt_disable ();
+		step_bench (impl, &rule, src, out, stat);
+		preempt_enable ();
+
+		printk (KERN_INFO "klife: %-6s step kernels: band %llu Mcells/s, tile %llu Mcells/s\n",
+			impl->name, impl->band_rate / 1000000, impl->tile_rate / 1000000);
+
+		if (!best || impl->band_rate + impl->tile_rate > best->band_rate + best->tile_rate)
+			best = impl;
+	}
+
+	kfree (src);
+	kfree (stat);
+
+	if (!best) {
+		printk (KERN_WARNING "klife: step kernels %s are not usable\n", step_kernel);
+		return -EINVAL;
+	}
+
+	klife_step_impl = best;
+	printk (KERN_INFO "klife: using %s step kernels\n", best->name);
+	return 0;
+}
+
+
+/* Allow use of vector registers by selected kernels, it disables preemption */
+void klife_step_begin (void)
+{
+	if (klife_step_impl->fpu)
+		kernel_fpu_begin ();
+}
+
+
+void klife_step_end (void)
+{
+	if (klife_step_impl->fpu)
+		kernel_fpu_end ();
+}
+
+
+/*
+ * Format selected kernels and measured rates of all implementations for status.
+ *
+ * Returns length of the string.
+ */
+int klife_step_report (char *buf, size_t size)
+{
+	struct klife_step_impl *impl;
+	int len;
+	unsigned int i;
+
+	len = snprintf (buf, size, "Step kernels: %s\n", klife_step_impl->name);
+
+	for (i = 0; i < STEP_IMPLS && len < size; i++) {
+		impl = &step_impls[i];
+		if (!impl->band_rate)
+			continue;
+		len += snprintf (buf + len, size - len, "Kernel %s: band %llu cells/s, tile %llu cells/s\n",
+				 impl->name, impl->band_rate, impl->tile_rate);
+	}
+
+	return min_t (int, len, size);
+}
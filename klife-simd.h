@@ -0,0 +1,286 @@
+/*
+ * Step kernels on vector registers.
+ *
+ * This file is a template, which is included by klife-simd-*.c. Every of them is compiled
+ * with its instruction set enabled, and defines SIMD_WORDS (amount of 64-bit words in
+ * vector) and SIMD_FN (name of exported routine). Vectors are GCC vector extensions, so
+ * compiler makes the same code for any vector width, and rule is the same as in portable
+ * kernels (see klife-cells.h).
+ *
+ * Vector holds SIMD_WORDS words which are neighbours in memory: words of one row in the
+ * band kernel, and rows of one tile column in the tile kernel. Neighbours of vector are
+ * loaded by unaligned loads shifted by one word, so every lane gets its own neighbours.
+ *
+ * Whole file is compiled with vector instructions allowed, so its routines could be
+ * called only between klife_step_begin and klife_step_end.
+ */
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/string.h>
+
+#include "klife-step.h"
+
+
+typedef u64 vec_t __attribute__ ((vector_size (SIMD_WORDS * sizeof (u64))));
+
+/* the same vector in memory, aligned as words only */
+typedef u64 uvec_t __attribute__ ((vector_size (SIMD_WORDS * sizeof (u64)), aligned (sizeof (u64))));
+
+#define CELLS vec_t
+#include "klife-cells.h"
+
+
+static inline vec_t vload (const u64 *p)
+{
+	return *(const uvec_t *)p;
+}
+
+
+static inline void vstore (u64 *p, vec_t v)
+{
+	*(uvec_t *)p = v;
+}
+
+
+/* OR of all lanes */
+static inline u64 vor (vec_t v)
+{
+	u64 res = 0;
+	unsigned int l;
+
+	for (l = 0; l < SIMD_WORDS; l++)
+		res |= v[l];
+	return res;
+}
+
+
+/* Stands for tiles outside of the field */
+static const u64 zero_tile[KLIFE_TILE_WORDS];
+
+
+/*
+ * Live cells are counted without extracting lanes: every byte of vector gets amount of its
+ * live cells (at most 8), such counts are summed by vector additions, and moved to 16-bit
+ * sums by vwiden before bytes could overflow (every VWIDEN_ADDS additions).
+ */
+#define VWIDEN_ADDS 16
+
+static inline vec_t vweight8 (vec_t v)
+{
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	return (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+}
+
+
+static inline vec_t vwiden (vec_t v)
+{
+	return (v & 0x00ff00ff00ff00ffULL) + ((v >> 8) & 0x00ff00ff00ff00ffULL);
+}
+
+
+/* Sum of 16-bit counts of word */
+static inline u32 sum16 (u64 w)
+{
+	return (w * 0x0001000100010001ULL) >> 48;
+}
+
+
+/*
+ * Band kernel, see klife_step_band_u64. Band is calculated by columns of SIMD_WORDS words
+ * down through all its rows, so results of every column are accumulated in registers.
+ * The first and the last words of row have neighbours on the other side of row (or
+ * outside of the field), they and words left out of whole vectors are calculated by
+ * portable kernel.
+ */
+static __always_inline void simd_band (u32 table, const struct klife_rule *rule,
+				       const u64 *up, const u64 *src, const u64 *down, u64 *out,
+				       unsigned int rows, unsigned int from, unsigned int to,
+				       unsigned int words, int wrap, struct klife_step_stat *stat)
+{
+	vec_t uw, uc, ue, mw, mc, me, dw, dc, de;
+	vec_t res, live, diff, mask, zero = { 0 };
+	vec_t pop8, born8, pop16, born16;
+	unsigned int lo, hi, i, r, l;
+	const u64 *p;
+
+	lo = max (from, 1U);
+	hi = min (to, words - 1);
+	if (lo >= hi || hi - lo < SIMD_WORDS) {
+		klife_step_band_u64 (rule, up, src, down, out, rows, from, to, words, wrap, stat);
+		return;
+	}
+	hi = lo + (hi - lo) / SIMD_WORDS * SIMD_WORDS;
+
+	for (i = lo; i < hi; i += SIMD_WORDS) {
+		live = diff = mask = zero;
+		pop8 = born8 = pop16 = born16 = zero;
+
+		if (up) {
+			uw = vload (up + i - 1);
+			uc = vload (up + i);
+			ue = vload (up + i + 1);
+		}
+		else
+			uw = uc = ue = zero;
+
+		mw = vload (src + i - 1);
+		mc = vload (src + i);
+		me = vload (src + i + 1);
+
+		for (r = 0; r < rows; r++) {
+			p = r + 1 < rows ? src + (unsigned long)(r + 1) * words : down;
+			if (likely (p)) {
+				dw = vload (p + i - 1);
+				dc = vload (p + i);
+				de = vload (p + i + 1);
+			}
+			else
+				dw = dc = de = zero;
+
+			res = rule_word (table, west (uc, uw), uc, east (uc, ue),
+					 west (mc, mw), mc, east (mc, me),
+					 west (dc, dw), dc, east (dc, de));
+			vstore (out + (unsigned long)r * words + i, res);
+			live |= res;
+			diff |= res ^ mc;
+
+			/* lanes of non-empty words are all ones after comparison */
+			mask |= (vec_t)(res != zero) & (1ULL << r);
+			pop8 += vweight8 (res);
+			born8 += vweight8 (res & ~mc);
+			if ((r + 1) % VWIDEN_ADDS == 0 || r + 1 == rows) {
+				pop16 += vwiden (pop8);
+				born16 += vwiden (born8);
+				pop8 = born8 = zero;
+			}
+
+			uw = mw; uc = mc; ue = me;
+			mw = dw; mc = dc; me = de;
+		}
+
+		for (l = 0; l < SIMD_WORDS; l++) {
+			stat[i + l].live |= live[l];
+			stat[i + l].diff |= diff[l];
+			stat[i + l].rows |= mask[l];
+			stat[i + l].pop += sum16 (pop16[l]);
+			stat[i + l].born += sum16 (born16[l]);
+		}
+	}
+
+	klife_step_band_u64 (rule, up, src, down, out, rows, from, lo, words, wrap, stat);
+	klife_step_band_u64 (rule, up, src, down, out, rows, hi, to, words, wrap, stat);
+}
+
+
+/*
+ * Tile kernel, see klife_step_tile_u64. Vector is SIMD_WORDS rows of tile column, rows
+ * above and below it are taken by loads shifted by one row. The first and the last
+ * vectors of column need rows of tiles above and below, they are gathered into edge.
+ */
+static __always_inline void simd_tile (u32 table, const u64 * const tiles[9], u64 *out,
+				       struct klife_step_stat *stat)
+{
+	u64 edge[6][SIMD_WORDS];
+	const u64 *t[9];
+	vec_t u[3], m[3], d[3];
+	vec_t res, live, diff, zero = { 0 };
+	vec_t pop8, born8, pop16, born16;
+	unsigned int i, j, r;
+	u64 rows = 0;
+
+	for (i = 0; i < 9; i++)
+		t[i] = tiles[i] ? tiles[i] : zero_tile;
+
+	/* j is column: west, centre and east */
+	for (j = 0; j < 3; j++) {
+		edge[j][0] = t[j][KLIFE_TILE_WORDS - 1];
+		memcpy (&edge[j][1], t[3 + j], (SIMD_WORDS - 1) * sizeof (u64));
+		memcpy (&edge[3 + j][0], t[3 + j] + KLIFE_TILE_WORDS - SIMD_WORDS + 1,
+			(SIMD_WORDS - 1) * sizeof (u64));
+		edge[3 + j][SIMD_WORDS - 1] = t[6 + j][0];
+	}
+
+	live = diff = zero;
+	pop8 = born8 = pop16 = born16 = zero;
+
+	for (r = 0; r < KLIFE_TILE_WORDS; r += SIMD_WORDS) {
+		for (j = 0; j < 3; j++) {
+			u[j] = r ? vload (t[3 + j] + r - 1) : vload (edge[j]);
+			m[j] = vload (t[3 + j] + r);
+			d[j] = r + SIMD_WORDS < KLIFE_TILE_WORDS ? vload (t[3 + j] + r + 1) : vload (edge[3 + j]);
+		}
+
+		res = rule_word (table, west (u[1], u[0]), u[1], east (u[1], u[2]),
+				 west (m[1], m[0]), m[1], east (m[1], m[2]),
+				 west (d[1], d[0]), d[1], east (d[1], d[2]));
+		vstore (out + r, res);
+		live |= res;
+		diff |= res ^ m[1];
+		pop8 += vweight8 (res);
+		born8 += vweight8 (res & ~m[1]);
+		if ((r / SIMD_WORDS + 1) % VWIDEN_ADDS == 0 || r + SIMD_WORDS == KLIFE_TILE_WORDS) {
+			pop16 += vwiden (pop8);
+			born16 += vwiden (born8);
+			pop8 = born8 = zero;
+		}
+	}
+
+	for (r = 0; r < KLIFE_TILE_WORDS; r++)
+		if (out[r])
+			rows |= 1ULL << r;
+
+	stat->live = vor (live);
+	stat->diff = vor (diff);
+	stat->rows = rows;
+	stat->pop = stat->born = 0;
+	for (i = 0; i < SIMD_WORDS; i++) {
+		stat->pop += sum16 (pop16[i]);
+		stat->born += sum16 (born16[i]);
+	}
+}
+
+
+void SIMD_FN (step_band) (const struct klife_rule *rule, const u64 *up, const u64 *src,
+			  const u64 *down, u64 *out, unsigned int rows, unsigned int from,
+			  unsigned int to, unsigned int words, int wrap, struct klife_step_stat *stat)
+{
+	switch (rule->kernel) {
+	case KLIFE_KERNEL_CONWAY:
+		simd_band (KLIFE_TABLE_CONWAY, rule, up, src, down, out, rows, from, to, words, wrap, stat);
+		break;
+	case KLIFE_KERNEL_HIGHLIFE:
+		simd_band (KLIFE_TABLE_HIGHLIFE, rule, up, src, down, out, rows, from, to, words, wrap, stat);
+		break;
+	case KLIFE_KERNEL_SEEDS:
+		simd_band (KLIFE_TABLE_SEEDS, rule, up, src, down, out, rows, from, to, words, wrap, stat);
+		break;
+	case KLIFE_KERNEL_DAYNIGHT:
+		simd_band (KLIFE_TABLE_DAYNIGHT, rule, up, src, down, out, rows, from, to, words, wrap, stat);
+		break;
+	default:
+		simd_band (rule->table, rule, up, src, down, out, rows, from, to, words, wrap, stat);
+	}
+}
+
+
+void SIMD_FN (step_tile) (const struct klife_rule *rule, const u64 * const tiles[9], u64 *out,
+			  struct klife_step_stat *stat)
+{
+	switch (rule->kernel) {
+	case KLIFE_KERNEL_CONWAY:
+		simd_tile (KLIFE_TABLE_CONWAY, tiles, out, stat);
+		break;
+	case KLIFE_KERNEL_HIGHLIFE:
+		simd_tile (KLIFE_TABLE_HIGHLIFE, tiles, out, stat);
+		break;
+	case KLIFE_KERNEL_SEEDS:
+		simd_tile (KLIFE_TABLE_SEEDS, tiles, out, stat);
+		break;
+	case KLIFE_KERNEL_DAYNIGHT:
+		simd_tile (KLIFE_TABLE_DAYNIGHT, tiles, out, stat);
+		break;
+	default:
+		simd_tile (rule->table, tiles, out, stat);
+	}
+}
@@ -0,0 +1,354 @@
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/bitops.h>
+
+#include "klife-step.h"
+
+
+/*
+ * Generation step kernels.
+ *
+ * Cells are never processed one by one. Instead, every neighbour of 64 cells is taken at
+ * once as a shifted copy of the field word, and eight such words are summed by a tree of
+ * bit-sliced adders, which gives a neighbour count for all 64 cells in a few dozens of
+ * logic operations.
+ *
+ * This file has portable kernels, which work on 64-bit words. Kernels which use vector
+ * instructions are built from klife-simd.h, one of them is selected in klife-simd.c.
+ */
+
+
+/* kernels of this file work on single words */
+#define CELLS u64
+#include "klife-cells.h"
+
+
+/* Word of row, rows outside of the field (NULL) are dead */
+static inline u64 row_word (const u64 *row, unsigned int i)
+{
+	return row ? row[i] : 0;
+}
+
+
+/*
+ * Calculate next generation of words [from, to) of row mid, given rows above and below it.
+ * Result is written to out, which must not overlap with any of source rows. Cells outside
+ * of row are dead, unless wrap is set: then the first and the last words of row are
+ * neighbours, as on torus. Up or down could be NULL if mid is the first or the last row of
+ * the field. Words of source rows outside of [from, to) are used as neighbours.
+ *
+ * Results are accumulated into stat array, one item for each word of row, row is the bit of
+ * this row in their rows masks.
+ */
+static __always_inline void step_row (u32 table, const u64 *up, const u64 *mid, const u64 *down,
+				      u64 *out, unsigned int from, unsigned int to, unsigned int words,
+				      int wrap, u64 row, struct klife_step_stat *stat)
+{
+	u64 up_p, mid_p, dn_p;
+	u64 up_c, mid_c, dn_c;
+	u64 up_n, mid_n, dn_n;
+	unsigned int i, p;
+
+	if (unlikely (from >= to))
+		return;
+
+	if (likely (from || wrap)) {
+		p = from ? from-1 : words-1;
+		up_p = row_word (up, p);
+		mid_p = mid[p];
+		dn_p = row_word (down, p);
+	}
+	else
+		up_p = mid_p = dn_p = 0;
+
+	up_c = row_word (up, from);
+	mid_c = mid[from];
+	dn_c = row_word (down, from);
+
+	for (i = from; i < to; i++) {
+		if (likely (i + 1 < words)) {
+			up_n = row_word (up, i+1);
+			mid_n = mid[i+1];
+			dn_n = row_word (down, i+1);
+		}
+		else if (wrap) {
+			up_n = row_word (up, 0);
+			mid_n = mid[0];
+			dn_n = row_word (down, 0);
+		}
+		else
+			up_n = mid_n = dn_n = 0;
+
+		out[i] = rule_word (table, west (up_c, up_p), up_c, east (up_c, up_n),
+				    west (mid_c, mid_p), mid_c, east (mid_c, mid_n),
+				    west (dn_c, dn_p), dn_c, east (dn_c, dn_n));
+		stat[i].live |= out[i];
+		stat[i].diff |= out[i] ^ mid_c;
+		stat[i].rows |= out[i] ? row : 0;
+		stat[i].pop += hweight64 (out[i]);
+		stat[i].born += hweight64 (out[i] & ~mid_c);
+
+		up_p = up_c; up_c = up_n;
+		mid_p = mid_c; mid_c = mid_n;
+		dn_p = dn_c; dn_c = dn_n;
+	}
+}
+
+
+static __always_inline void step_band (u32 table, const u64 *up, const u64 *src,
+				       const u64 *down, u64 *out, unsigned int rows, unsigned int from,
+				       unsigned int to, unsigned int words, int wrap,
+				       struct klife_step_stat *stat)
+{
+	const u64 *row;
+	unsigned int r;
+
+	for (r = 0; r < rows; r++) {
+		row = src + (unsigned long)r * words;
+		step_row (table, r ? row - words : up, row, r + 1 < rows ? row + words : down,
+			  out + (unsigned long)r * words, from, to, words, wrap, 1ULL << r, stat);
+	}
+}
+
+
+/*
+ * Calculate next generation of words [from, to) of every row of band. Band is rows rows
+ * (at most 64) of words words each, which follow one another from src, up and down are
+ * rows above and below the band (NULL outside of the field). Results are written to out,
+ * which has the same geometry as the band. Wrap and stat are the same as for step_row,
+ * stat's rows masks have bit per row of band.
+ */
+void klife_step_band_u64 (const struct klife_rule *rule, const u64 *up, const u64 *src,
+			  const u64 *down, u64 *out, unsigned int rows, unsigned int from,
+			  unsigned int to, unsigned int words, int wrap, struct klife_step_stat *stat)
+{
+	switch (rule->kernel) {
+	case KLIFE_KERNEL_CONWAY:
+		step_band (KLIFE_TABLE_CONWAY, up, src, down, out, rows, from, to, words, wrap, stat);
+		break;
+	case KLIFE_KERNEL_HIGHLIFE:
+		step_band (KLIFE_TABLE_HIGHLIFE, up, src, down, out, rows, from, to, words, wrap, stat);
+		break;
+	case KLIFE_KERNEL_SEEDS:
+		step_band (KLIFE_TABLE_SEEDS, up, src, down, out, rows, from, to, words, wrap, stat);
+		break;
+	case KLIFE_KERNEL_DAYNIGHT:
+		step_band (KLIFE_TABLE_DAYNIGHT, up, src, down, out, rows, from, to, words, wrap, stat);
+		break;
+	default:
+		step_band (rule->table, up, src, down, out, rows, from, to, words, wrap, stat);
+	}
+}
+
+
+/* Stands for tiles outside of the field */
+static const u64 zero_tile[KLIFE_TILE_WORDS];
+
+
+/*
+ * Calculate next generation of the tile. Tiles are given in array of 9 items, where
+ * tiles[4] is the tile to calculate and others are its neighbours, row by row from
+ * north-west to south-east. Neighbours outside of the field are NULL. Neighbours could be
+ * the same tile (on small torus), tiles are only read.
+ *
+ * Results of the tile are written to stat.
+ */
+static __always_inline void step_tile (u32 table, const u64 * const tiles[9], u64 *out,
+				       struct klife_step_stat *stat)
+{
+	const u64 *t[9];
+	u64 uw, uc, ue, mw, mc, me, dw, dc, de;
+	u64 live = 0, diff = 0, rows = 0;
+	unsigned int i, r, pop = 0, born = 0;
+
+	for (i = 0; i < 9; i++)
+		t[i] = tiles[i] ? tiles[i] : zero_tile;
+
+	uw = t[0][KLIFE_TILE_WORDS-1];
+	uc = t[1][KLIFE_TILE_WORDS-1];
+	ue = t[2][KLIFE_TILE_WORDS-1];
+	mw = t[3][0];
+	mc = t[4][0];
+	me = t[5][0];
+
+	for (r = 0; r < KLIFE_TILE_WORDS; r++) {
+		if (likely (r + 1 < KLIFE_TILE_WORDS)) {
+			dw = t[3][r+1];
+			dc = t[4][r+1];
+			de = t[5][r+1];
+		}
+		else {
+			dw = t[6][0];
+			dc = t[7][0];
+			de = t[8][0];
+		}
+
+		out[r] = rule_word (table, west (uc, uw), uc, east (uc, ue),
+				    west (mc, mw), mc, east (mc, me),
+				    west (dc, dw), dc, east (dc, de));
+		live |= out[r];
+		diff |= out[r] ^ mc;
+		if (out[r])
+			rows |= 1ULL << r;
+		pop += hweight64 (out[r]);
+		born += hweight64 (out[r] & ~mc);
+
+		uw = mw; uc = mc; ue = me;
+		mw = dw; mc = dc; me = de;
+	}
+
+	stat->live = live;
+	stat->diff = diff;
+	stat->rows = rows;
+	stat->pop = pop;
+	stat->born = born;
+}
+
+
+void klife_step_tile_u64 (const struct klife_rule *rule, const u64 * const tiles[9], u64 *out,
+			  struct klife_step_stat *stat)
+{
+	switch (rule->kernel) {
+	case KLIFE_KERNEL_CONWAY:
+		step_tile (KLIFE_TABLE_CONWAY, tiles, out, stat);
+		break;
+	case KLIFE_KERNEL_HIGHLIFE:
+		step_tile (KLIFE_TABLE_HIGHLIFE, tiles, out, stat);
+		break;
+	case KLIFE_KERNEL_SEEDS:
+		step_tile (KLIFE_TABLE_SEEDS, tiles, out, stat);
+		break;
+	case KLIFE_KERNEL_DAYNIGHT:
+		step_tile (KLIFE_TABLE_DAYNIGHT, tiles, out, stat);
+		break;
+	default:
+		step_tile (rule->table, tiles, out, stat);
+	}
+}
+
+
+/*
+ * Calculate given amount of generations of small square block in place. Block has side
+ * cells (at most 64), one word per row. Cells outside of block are dead. It's used by
+ * HashLife for small nodes only, so it's not specialized for rules.
+ */
+void klife_step_block (const struct klife_rule *rule, u64 *rows, unsigned int side, unsigned int gens)
+{
+	u64 mask = side < KLIFE_WORD_BITS ? (1ULL << side) - 1 : ~0ULL;
+	u64 up, mid, next;
+	unsigned int g, r;
+
+	for (g = 0; g < gens; g++) {
+		up = 0;
+		for (r = 0; r < side; r++) {
+			mid = rows[r];
+			next = r + 1 < side ? rows[r+1] : 0;
+			rows[r] = rule_word (rule->table, up << 1, up, up >> 1,
+					     mid << 1, mid, mid >> 1,
+					     next << 1, next, next >> 1) & mask;
+			up = mid;
+		}
+	}
+}
+
+
+/* Specialized kernels, in order of KLIFE_KERNEL_* */
+static const u32 kernel_tables[] = {
+	[KLIFE_KERNEL_CONWAY] = KLIFE_TABLE_CONWAY,
+	[KLIFE_KERNEL_HIGHLIFE] = KLIFE_TABLE_HIGHLIFE,
+	[KLIFE_KERNEL_SEEDS] = KLIFE_TABLE_SEEDS,
+	[KLIFE_KERNEL_DAYNIGHT] = KLIFE_TABLE_DAYNIGHT,
+};
+
+
+static void rule_select_kernel (struct klife_rule *rule)
+{
+	unsigned int i;
+
+	rule->kernel = KLIFE_KERNEL_GENERIC;
+	for (i = KLIFE_KERNEL_GENERIC + 1; i < ARRAY_SIZE (kernel_tables); i++)
+		if (kernel_tables[i] == rule->table)
+			rule->kernel = i;
+}
+
+
+void klife_rule_conway (struct klife_rule *rule)
+{
+	rule->table = KLIFE_TABLE_CONWAY;
+	rule->kernel = KLIFE_KERNEL_CONWAY;
+}
+
+
+/*
+ * Parse rule in B/S notation, like "B3/S23" (letters in any case, parts in any order,
+ * either of parts could be empty). Births without neighbours are not supported, because
+ * they make infinite plane alive.
+ *
+ * Return 0 if succeeded, -EINVAL otherwise.
+ */
+int klife_rule_parse (const char *str, struct klife_rule *rule)
+{
+	u32 birth = 0, survive = 0, *set;
+	int seen_b = 0, seen_s = 0;
+
+	while (*str) {
+		switch (*str) {
+		case 'B':
+		case 'b':
+			if (seen_b++)
+				return -EINVAL;
+			set = &birth;
+			break;
+		case 'S':
+		case 's':
+			if (seen_s++)
+				return -EINVAL;
+			set = &survive;
+			break;
+		default:
+			return -EINVAL;
+		}
+
+		for (str++; *str >= '0' && *str <= '8'; str++)
+			*set |= 1 << (*str - '0');
+
+		if (*str == '/')
+			str++;
+		else if (*str)
+			return -EINVAL;
+	}
+
+	if (!seen_b || !seen_s || (birth & 1))
+		return -EINVAL;
+
+	rule->table = KLIFE_RULE_TABLE (birth, survive);
+	rule_select_kernel (rule);
+
+	return 0;
+}
+
+
+/*
+ * Format rule in B/S notation into buf.
+ *
+ * Returns length of the string.
+ */
+int klife_rule_format (const struct klife_rule *rule, char *buf, size_t size)
+{
+	char str[KLIFE_RULE_MAX], *p = str;
+	unsigned int i;
+
+	*p++ = 'B';
+	for (i = 0; i <= 8; i++)
+		if (rule->table & (1 << i))
+			*p++ = '0' + i;
+	*p++ = '/';
+	*p++ = 'S';
+	for (i = 0; i <= 8; i++)
+		if (rule->table & (1 << (16 + i)))
+			*p++ = '0' + i;
+	*p = 0;
+
+	return snprintf (buf, size, "%s", str);
+}
@@ -0,0 +1,127 @@
+#ifndef __KLIFE_STEP_H__
+#define __KLIFE_STEP_H__
+
+#include <linux/types.h>
+
+/* Field is packed into 64-bit words, bit N of word W is the cell with X = W*64 + N */
+#define KLIFE_WORD_BITS 64
+#define KLIFE_WORD_SHIFT 6
+
+/* Tile is 64x64 cells block, 64 words (one per row) */
+#define KLIFE_TILE_SHIFT KLIFE_WORD_SHIFT
+#define KLIFE_TILE_WORDS (1 << KLIFE_TILE_SHIFT)
+
+
+/*
+ * Life-like rule in B/S notation. Table has bit N set if dead cell with N live neighbours
+ * is born, and bit 16+N set if live cell with N live neighbours survives. Kernel selects
+ * step kernel specialized for the rule, if there is one.
+ */
+struct klife_rule {
+	u32 table;
+	unsigned int kernel;
+};
+
+#define KLIFE_RULE_TABLE(birth, survive) ((u32)(birth) | ((u32)(survive) << 16))
+
+/* rules which have specialized kernels */
+#define KLIFE_TABLE_CONWAY	KLIFE_RULE_TABLE (0x008, 0x00c)	/* B3/S23 */
+#define KLIFE_TABLE_HIGHLIFE	KLIFE_RULE_TABLE (0x048, 0x00c)	/* B36/S23 */
+#define KLIFE_TABLE_SEEDS	KLIFE_RULE_TABLE (0x004, 0x000)	/* B2/S */
+#define KLIFE_TABLE_DAYNIGHT	KLIFE_RULE_TABLE (0x1c8, 0x1d8)	/* B3678/S34678 */
+
+enum {
+	KLIFE_KERNEL_GENERIC,
+	KLIFE_KERNEL_CONWAY,
+	KLIFE_KERNEL_HIGHLIFE,
+	KLIFE_KERNEL_SEEDS,
+	KLIFE_KERNEL_DAYNIGHT,
+};
+
+/* longest rule string, "B012345678/S012345678" */
+#define KLIFE_RULE_MAX 24
+
+
+/* Kernel results, accumulated over words of one tile column */
+struct klife_step_stat {
+	u64 live;		/* OR of result words */
+	u64 diff;		/* OR of changed cells */
+	u64 rows;		/* mask of non-empty result rows */
+	u32 pop;		/* live cells of result */
+	u32 born;		/* cells which are live in result, but not in source */
+};
+
+
+extern int klife_rule_parse (const char *str, struct klife_rule *rule);
+extern int klife_rule_format (const struct klife_rule *rule, char *buf, size_t size);
+extern void klife_rule_conway (struct klife_rule *rule);
+
+
+/*
+ * Implementation of step kernels. Portable one works on 64-bit words, others use vector
+ * registers and calculate several words at once. The fastest implementation usable on
+ * this CPU is selected at module load, see klife-simd.c.
+ */
+struct klife_step_impl {
+	const char *name;
+
+	/* returns non-zero if CPU supports implementation */
+	int (*usable) (void);
+
+	/* uses vector registers, so it could be called only between klife_step_begin/end */
+	int fpu;
+
+	void (*step_band) (const struct klife_rule *rule, const u64 *up, const u64 *src,
+			   const u64 *down, u64 *out, unsigned int rows, unsigned int from,
+			   unsigned int to, unsigned int words, int wrap,
+			   struct klife_step_stat *stat);
+	void (*step_tile) (const struct klife_rule *rule, const u64 * const tiles[9], u64 *out,
+			   struct klife_step_stat *stat);
+
+	/* measured at load, cells per second of band and tile kernels */
+	u64 band_rate, tile_rate;
+};
+
+extern struct klife_step_impl *klife_step_impl;
+
+/*
+ * Amount of band words or tiles calculated between klife_step_begin and klife_step_end,
+ * which is 64K cells. Preemption is disabled there, so it's kept short.
+ */
+#define KLIFE_STEP_CHUNK 16
+
+extern int klife_step_select (void);
+extern void klife_step_begin (void);
+extern void klife_step_end (void);
+extern int klife_step_report (char *buf, size_t size);
+
+extern void klife_step_band_u64 (const struct klife_rule *rule, const u64 *up, const u64 *src,
+				 const u64 *down, u64 *out, unsigned int rows, unsigned int from,
+				 unsigned int to, unsigned int words, int wrap,
+				 struct klife_step_stat *stat);
+extern void klife_step_tile_u64 (const struct klife_rule *rule, const u64 * const tiles[9],
+				 u64 *out, struct klife_step_stat *stat);
+
+
+/* Calculate band of rows by selected implementation, see klife_step_band_u64 */
+static inline void klife_step_band (const struct klife_rule *rule, const u64 *up, const u64 *src,
+				    const u64 *down, u64 *out, unsigned int rows, unsigned int from,
+				    unsigned int to, unsigned int words, int wrap,
+				    struct klife_step_stat *stat)
+{
+	klife_step_impl->step_band (rule, up, src, down, out, rows, from, to, words, wrap, stat);
+}
+
+
+/* Calculate tile by selected implementation, see klife_step_tile_u64 */
+static inline void klife_step_tile (const struct klife_rule *rule, const u64 * const tiles[9],
+				    u64 *out, struct klife_step_stat *stat)
+{
+	klife_step_impl->step_tile (rule, tiles, out, stat);
+}
+
+
+extern void klife_step_block (const struct klife_rule *rule, u64 *rows, unsigned int side,
+			      unsigned int gens);
+
+#endif
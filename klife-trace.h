@@ -0,0 +1,139 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM klife
+
+#if !defined(__KLIFE_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __KLIFE_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+#include "klife.h"
+
+
+/*
+ * Tracepoints of the board's work, they are defined in klife-debug.c. Scratch boards of
+ * benchmark have index -1.
+ */
+
+TRACE_EVENT (klife_gen_start,
+
+	TP_PROTO (struct klife_board *board),
+
+	TP_ARGS (board),
+
+	TP_STRUCT__entry (
+		__field (int, index)
+		__field (unsigned long long, generation)
+		__field (unsigned int, threads)
+	),
+
+	TP_fast_assign (
+		__entry->index = board->index;
+		__entry->generation = board->generation;
+		__entry->threads = board->threads;
+	),
+
+	TP_printk ("board=%d generation=%llu threads=%u",
+		   __entry->index, __entry->generation, __entry->threads)
+);
+
+
+TRACE_EVENT (klife_gen_end,
+
+	TP_PROTO (struct klife_board *board, u64 step_ns),
+
+	TP_ARGS (board, step_ns),
+
+	TP_STRUCT__entry (
+		__field (int, index)
+		__field (unsigned long long, generation)
+		__field (u64, population)
+		__field (u64, births)
+		__field (u64, deaths)
+		__field (unsigned int, tiles)
+		__field (u64, step_ns)
+	),
+
+	TP_fast_assign (
+		__entry->index = board->index;
+		__entry->generation = board->generation;
+		__entry->population = board->population;
+		__entry->births = board->births;
+		__entry->deaths = board->deaths;
+		__entry->tiles = board->tiles_active;
+		__entry->step_ns = step_ns;
+	),
+
+	TP_printk ("board=%d generation=%llu population=%llu births=%llu deaths=%llu tiles=%u step_ns=%llu",
+		   __entry->index, __entry->generation,
+		   (unsigned long long)__entry->population, (unsigned long long)__entry->births,
+		   (unsigned long long)__entry->deaths, __entry->tiles,
+		   (unsigned long long)__entry->step_ns)
+);
+
+
+TRACE_EVENT (klife_enlarge,
+
+	TP_PROTO (struct klife_board *board, unsigned int old_width, u64 alloc_ns, u64 copy_ns),
+
+	TP_ARGS (board, old_width, alloc_ns, copy_ns),
+
+	TP_STRUCT__entry (
+		__field (int, index)
+		__field (unsigned int, old_width)
+		__field (unsigned int, width)
+		__field (unsigned int, height)
+		__field (unsigned int, pages_power)
+		__field (int, vmapped)
+		__field (u64, alloc_ns)
+		__field (u64, copy_ns)
+	),
+
+	TP_fast_assign (
+		__entry->index = board->index;
+		__entry->old_width = old_width;
+		__entry->width = board->field_width;
+		__entry->height = board->field_height;
+		__entry->pages_power = board->pages_power;
+		__entry->vmapped = board->field_vmapped;
+		__entry->alloc_ns = alloc_ns;
+		__entry->copy_ns = copy_ns;
+	),
+
+	TP_printk ("board=%d width=%u->%u height=%u pages=%lu vmalloc=%d alloc_ns=%llu copy_ns=%llu",
+		   __entry->index, __entry->old_width, __entry->width, __entry->height,
+		   1UL << __entry->pages_power, __entry->vmapped,
+		   (unsigned long long)__entry->alloc_ns, (unsigned long long)__entry->copy_ns)
+);
+
+
+TRACE_EVENT (klife_batch_apply,
+
+	TP_PROTO (struct klife_board *board, unsigned long changes, u64 ns),
+
+	TP_ARGS (board, changes, ns),
+
+	TP_STRUCT__entry (
+		__field (int, index)
+		__field (unsigned long, changes)
+		__field (u64, ns)
+	),
+
+	TP_fast_assign (
+		__entry->index = board->index;
+		__entry->changes = changes;
+		__entry->ns = ns;
+	),
+
+	TP_printk ("board=%d changes=%lu ns=%llu",
+		   __entry->index, __entry->changes, (unsigned long long)__entry->ns)
+);
+
+#endif
+
+/* this header is not in include/trace/events */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE klife-trace
+
+#include <trace/define_trace.h>
@@ -0,0 +1,219 @@
+#ifndef __KLIFE_UAPI_H__
+#define __KLIFE_UAPI_H__
+
+/*
+ * Definitions shared with userspace programs.
+ */
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+
+/*
+ * Board's field mapping (mmap of /proc/klife/boards/N/field).
+ *
+ * First page of mapping is the header below, it's followed by two buffers of buffer_size
+ * bytes: buffer 0 at offset PAGE_SIZE and buffer 1 right after it. Buffer cur_buffer
+ * holds the current generation, the other one is used by kernel to calculate the next.
+ * Field is packed into 64-bit words as inside of the kernel, in the given layout.
+ *
+ * Header and field are changed by kernel at any time, so reader must use seq:
+ *
+ *	do {
+ *		s = hdr->seq;			(wait while it's odd)
+ *		rmb ();
+ *		copy buffer hdr->cur_buffer ...
+ *		rmb ();
+ *	} while (hdr->seq != s);
+ *
+ * seq is odd while field is being modified, and is changed every time the buffers are
+ * swapped, so copy is consistent if seq didn't change during it. Field is not enlarged
+ * while it's mapped.
+ */
+#define KLIFE_MMAP_MAGIC 0x4b4c4946	/* "KLIF" */
+
+struct klife_mmap_header {
+	__u32 magic;
+	__u32 seq;
+	__u64 generation;
+
+	/* width of allocated field (length of row) and side of live area, in cells */
+	__u32 field_side;
+	__u32 side;
+
+	/* 0 - linear (row by row), 1 - tiled (64x64 tiles, tile by tile) */
+	__u32 layout;
+
+	/* buffer of the current generation, 0 or 1 */
+	__u32 cur_buffer;
+
+	/* size of each buffer in bytes, zero if field is not allocated yet */
+	__u64 buffer_size;
+
+	/* height of allocated field (amount of rows), topology of board (KLIFE_TOPOLOGY_*) */
+	__u32 field_height;
+	__u32 topology;
+};
+
+
+/*
+ * Binary access to board's cells (/proc/klife/boards/N/raw).
+ *
+ * Cells are packed row by row, every row takes (w+7)/8 bytes, cell x+X of the row is bit
+ * X%8 of byte X/8. Read returns the cells of file's window, which is the whole field by
+ * default. Write must start with the header: write of the header alone sets the window,
+ * write of the header followed by h packed rows replaces cells of the rectangle and sets
+ * the window to it.
+ */
+struct klife_raw_header {
+	__u32 x, y;
+	__u32 w, h;
+};
+
+
+/*
+ * Generation events (/proc/klife/boards/N/events). Read returns array of events, one per
+ * step or jump finished since the previous read (or since open), and blocks until there
+ * is one, unless file is non-blocking. poll reports POLLIN when event is ready and POLLHUP
+ * when board is deleted. Board keeps only the last KLIFE_EVENTS_RING events, missed is
+ * amount of events lost by the reader right before this one.
+ */
+#define KLIFE_EVENTS_RING 64
+
+struct klife_event {
+	__u64 generation;
+	__u64 time_ns;		/* monotonic time when generation was published */
+	__u64 missed;
+};
+
+
+/*
+ * Delta stream (/proc/klife/boards/N/delta). While file is open, every step or jump of the
+ * board appends record to the stream: the header below followed by size bytes of runs.
+ * Field is taken as array of 64-bit words in linear order (word wx of row y has index
+ * y * field_side/64 + wx, cell x+X is bit X of word, field_side is width of the field).
+ * Every run is struct klife_delta_run followed by count words: skip words are zero, next
+ * count words are as given. Words are XOR of the previous and the new generation, or the
+ * new field itself for KLIFE_DELTA_FULL records. Full record is the first one after open,
+ * after field is changed not by a step (cells written, field enlarged) and after overrun.
+ *
+ * Stream is kept in a bounded buffer (delta_ring_size module parameter). Records which
+ * don't fit into it are dropped, amount of them is given in 'dropped' of the next stored
+ * record. If full record doesn't fit into the buffer at all, KLIFE_DELTA_RESYNC record
+ * without data is stored instead: reader must take the field from the mapping (see above)
+ * once its generation is not less than the record's one, and skip records of generations
+ * which are not greater than the mapping's one. Read returns whole records only and blocks
+ * until there is one, unless file is non-blocking. File could be opened by one reader at
+ * once.
+ */
+#define KLIFE_DELTA_FULL 1
+#define KLIFE_DELTA_RESYNC 2
+
+struct klife_delta_header {
+	__u64 generation;
+	__u32 field_side;
+	__u32 flags;
+	__u32 size;
+	__u32 dropped;
+};
+
+struct klife_delta_run {
+	__u32 skip;
+	__u32 count;
+};
+
+
+/* Change of one cell, see board_apply_changes */
+enum {
+	KLIFE_CELL_SET,
+	KLIFE_CELL_CLEAR,
+	KLIFE_CELL_TOGGLE,
+};
+
+struct klife_cell_change {
+	__u32 x, y;
+	__u32 op;
+};
+
+
+/*
+ * Control device /dev/klife. Boards are addressed by index, as in /proc/klife/boards.
+ */
+#define KLIFE_NAME_MAX 64
+
+/* board modes, layouts and topologies */
+enum {
+	KLIFE_MODE_STEP,
+	KLIFE_MODE_RUN,
+};
+
+enum {
+	KLIFE_LAYOUT_LINEAR,
+	KLIFE_LAYOUT_TILED,
+};
+
+enum {
+	KLIFE_TOPOLOGY_PLANE,
+	KLIFE_TOPOLOGY_BOUNDED,
+	KLIFE_TOPOLOGY_TORUS,
+};
+
+/* room for the longest rule, "B012345678/S012345678" */
+#define KLIFE_RULE_LEN 24
+
+/*
+ * Plane boards have zero width and height, bounded and torus ones have fixed size, which
+ * must be a whole number of 64x64 tiles. Rule is in B/S notation, empty one is B3/S23.
+ */
+struct klife_ioc_create {
+	char name[KLIFE_NAME_MAX];
+	__u32 layout;
+	__u32 topology;
+	__u32 width, height;
+	char rule[KLIFE_RULE_LEN];
+	__s32 index;		/* out: index of created board */
+};
+
+struct klife_ioc_mode {
+	__s32 index;
+	__u32 mode;
+};
+
+struct klife_ioc_step {
+	__s32 index;
+	__u32 pad;
+	__u64 gens;
+};
+
+struct klife_ioc_changes {
+	__s32 index;
+	__u32 count;
+	__u64 changes;		/* pointer to array of count struct klife_cell_change */
+};
+
+/* upper limit of changes in one call */
+#define KLIFE_CHANGES_MAX (1 << 20)
+
+struct klife_ioc_stats {
+	__s32 index;
+	__u32 mode;
+	__u32 layout;
+	__u32 threads;
+	__u64 generation;
+	__u32 side;
+	__u32 field_side;
+	__u32 rate;
+	__u32 rate_achieved;
+	__u32 tiles_active;
+	__u32 tiles_live;
+};
+
+#define KLIFE_IOC_MAGIC 'K'
+
+#define KLIFE_IOC_CREATE	_IOWR (KLIFE_IOC_MAGIC, 1, struct klife_ioc_create)
+#define KLIFE_IOC_DESTROY	_IOW (KLIFE_IOC_MAGIC, 2, __s32)
+#define KLIFE_IOC_SET_MODE	_IOW (KLIFE_IOC_MAGIC, 3, struct klife_ioc_mode)
+#define KLIFE_IOC_STEP		_IOW (KLIFE_IOC_MAGIC, 4, struct klife_ioc_step)
+#define KLIFE_IOC_CHANGE	_IOW (KLIFE_IOC_MAGIC, 5, struct klife_ioc_changes)
+#define KLIFE_IOC_STATS		_IOWR (KLIFE_IOC_MAGIC, 6, struct klife_ioc_stats)
+
+#endif
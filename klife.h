@@ -3,13 +3,43 @@
 
 #include <linux/kernel.h>
 #include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/bitmap.h>
+#include <linux/kref.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+
+#include "klife-step.h"
+#include "klife-uapi.h"
 #include <linux/proc_fs.h>
 
 #define KLIFE_VER_MAJOR 0
 #define KLIFE_VER_MINOR 1
 
+/* upper limit of workers calculating one board */
+#define KLIFE_MAX_THREADS 64
+
+/* cells have coordinates below it, field of such side fits into the largest buffer */
+#define KLIFE_SIDE_MAX (1U << 30)
+
+/* generations kept in history ring, it's the longest period which could be detected */
+#define KLIFE_CYCLE_HISTORY 64
+
 
 struct klife_board;
+struct klife_hashlife;
+struct klife_delta;
+
+
+/* Finished generation, item of board's events ring */
+struct klife_gen_event {
+	u64 generation;
+	u64 time_ns;
+};
 
 
 struct klife_status {
@@ -19,6 +49,9 @@ struct klife_status {
 	int next_index;
 	unsigned long long ticks;
 	struct list_head boards;
+
+	/* workqueue executing stripes of generations */
+	struct workqueue_struct *wq;
 };
 
 
@@ -28,12 +61,129 @@ typedef enum {
 } klife_board_mode_t;
 
 
+/* Order of field words in memory */
+typedef enum {
+	KBL_LINEAR,		/* row by row */
+	KBL_TILED,		/* tile by tile (64x64 cells), tiles are stored row by row */
+} klife_board_layout_t;
+
+
+/*
+ * Topology of the field. Plane is infinite to the right and down: field is enlarged when
+ * pattern reaches its border. Other boards have fixed size, given at creation, and their
+ * field is allocated once. Cells outside of bounded field are dead, torus wraps around
+ * both of its edges.
+ */
+typedef enum {
+	KBT_PLANE,
+	KBT_BOUNDED,
+	KBT_TORUS,
+} klife_board_topology_t;
+
+
+/* Rectangle of cells [x0, x1) x [y0, y1), it's empty if x0 >= x1 */
+struct klife_box {
+	unsigned int x0, y0, x1, y1;
+};
+
+
+/*
+ * Live cells of one tile, box is given inside of tile and is valid only if pop isn't zero.
+ * Hash is XOR of hashes of tile's words (see word_hash), it's zero for empty tile.
+ */
+struct klife_tile_info {
+	u64 hash;
+	u16 pop;
+	u8 x0, y0, x1, y1;
+};
+
+
+/* Phases of board's work, which latencies are collected in histograms */
+typedef enum {
+	KLIFE_LAT_STEP,		/* calculation of generation */
+	KLIFE_LAT_LOCK,		/* wait for board's lock by writers */
+	KLIFE_LAT_ALLOC,	/* allocation of field buffers */
+	KLIFE_LAT_COPY,		/* copy and census of old field into new buffers */
+	KLIFE_LAT_PROC_READ,	/* read of board's proc files */
+	KLIFE_LAT_PROC_WRITE,	/* write of board's proc files */
+	KLIFE_LAT_PHASES,
+} klife_lat_phase_t;
+
+/* bucket N counts latencies of [2^N, 2^(N+1)) ns, the last one counts all longer ones */
+#define KLIFE_LAT_BUCKETS 40
+
+/* Histogram is updated without locks, phases could be measured concurrently */
+struct klife_lat_hist {
+	atomic64_t count;
+	atomic64_t sum_ns;
+	atomic64_t buckets[KLIFE_LAT_BUCKETS];
+};
+
+
+/* Generation recorded in history ring of cycle detection */
+struct klife_cycle_entry {
+	u64 generation;
+	u64 hash;
+	u64 population;
+};
+
+
+/* Board parameters, which are set at creation */
+struct klife_board_opts {
+	klife_board_layout_t layout;
+	struct klife_rule rule;
+
+	/* size of fixed board in cells (must be a whole number of tiles), ignored for plane */
+	klife_board_topology_t topology;
+	unsigned int width, height;
+};
+
+
+
+/* Part of generation (band of rows) calculated by one worker */
+struct klife_stripe {
+	struct work_struct work;
+	struct klife_board *board;
+
+	/* rows [y0, y1) of the field, only columns of tiles [tx0, tx1) could be active */
+	unsigned int y0, y1;
+	unsigned int tx0, tx1;
+
+	/* cells born and died in the stripe, change of field hash, changed tiles (box in
+	 * tiles) and amount of tiles calculated */
+	u64 born, died;
+	u64 hash;
+	struct klife_box changed;
+	unsigned int active;
+
+	/* per-word results of linear kernel (stat_words items) */
+	struct klife_step_stat *stat;
+	unsigned int stat_words;
+};
+
 
 /* Board is 2^x pages which represents square of bits */
 struct klife_board {
 	rwlock_t lock;
+
+	/* Link of boards list, which is traversed under RCU and changed under klife.lock */
 	struct list_head next;
 
+	/* Field and its geometry are changed only inside of board_frame_begin/end, which
+	 * bump this counter. Readers don't take the lock above, but retry while it changes
+	 * (see board_read_begin). Buffers replaced by enlarge are freed after RCU grace
+	 * period, so it's safe to read them under rcu_read_lock. */
+	seqcount_t seq;
+
+	/* Board is freed when the last reference is dropped. References are held by boards
+	 * list, open files and mappings of the board. */
+	struct kref refs;
+
+	/* Serializes modifications of the field: generation steps, cell changes and
+	 * reallocations. Could sleep, so generation is calculated without holding the lock
+	 * above, which is taken only to publish results. */
+	struct mutex mutex;
+
 	/* generic information */
 	int index;
 	char* name;
@@ -42,33 +192,149 @@ struct klife_board {
 	klife_board_mode_t mode;
 	int enabled;
 
-	/* board dimension in bits (board is square) */
+	/* board is deleted (unlinked from boards list), run thread could not be started
+	 * anymore */
+	int dead;
+
+	/* side of square with all live cells, in bits (it's only an upper bound) */
 	unsigned int side;
 
+	/* layout of field and field_next buffers */
+	klife_board_layout_t layout;
+
+	/* topology of the field, fixed boards never change field_width and field_height */
+	klife_board_topology_t topology;
+
+	/* rule of the board, changed under mutex */
+	struct klife_rule rule;
+
 	/* Board's data. Allocated by 2^n pages and represents
-	 * nearest square field, where each side is rounded by 8
-	 * bits. This size if saved in field_side.
+	 * nearest square field, where each side is rounded by 64
+	 * bits. This size if saved in field_width and field_height.
+	 *
+	 * For example, if pages_power=0, we have 4096 bytes (32768 bits) which gives us 181x181
+	 * field. To make rows consist of whole 64-bit words, we round this field to 128x128. Two
+	 * pages gives us 256x256 field. Of course, the above calculations is correct for x86
+	 * arch. For different page sizes, we can have more or less field sizes.
+	 *
+	 * Fixed boards have field of exactly width x height cells (whole number of tiles), which
+	 * could be not square, and buffers are the least 2^n pages which hold it.
 	 *
-	 * For example, if pages_power=1, we have 4096 bytes (32768 bits) which gives us 181x181
-	 * field. To make this divisible by bytes, we round this field to 176x176. Two pages gives
-	 * us 256x256 field. Of course, the above calculations is correct for x86 arch. For
-	 * different page sizes, we can have more or less field sizes */
-	char *field;
+	 * Large fields could exceed MAX_ORDER, such buffers are allocated by vmalloc. */
+	u64 *field;
 
-	/* represents 2^X pages allocated, but only if field is not null. If it is null, pages_power
+	/* Back buffer of the same size as field. Next generation is calculated into it, after
+	 * that field and field_next pointers are swapped. */
+	u64 *field_next;
+
+	/* represents 2^X pages allocated (for each buffer), but only if field is not null. If it is null, pages_power
 	 * must be zero, which represents zero pages. */
 	unsigned int pages_power;
 
-	/* contain side of square field (allocated) in bits */
-	unsigned int field_side;
+	/* Buffers are physically contiguous pages if it's possible, or vmalloc'ed otherwise.
+	 * Time of the last buffers allocation is kept for statistics. */
+	int field_vmapped;
+	u64 alloc_ns;
+
+	/* Buffers in order of allocation, field and field_next are swapped between them.
+	 * Mapping of the field to userspace places them in this order. */
+	u64 *buffers[2];
+
+	/* Header page of field mapping, kept up to date with the field, and amount of
+	 * mappings of the board (field is not reallocated while it's mapped). */
+	struct klife_mmap_header *header;
+	atomic_t maps;
+
+	/* size of allocated field in bits, both are multiples of 64 (and equal for plane) */
+	unsigned int field_width;
+	unsigned int field_height;
+
+	/* Tile maps (bit per tile, row by row, see board_tiles). Tile is changed if its cells in
+	 * field and field_next differ, i.e. it changed in the last generation or was modified
+	 * after. Only changed tiles and their neighbours are calculated by stepper, which
+	 * fills tiles_changed_next. tiles_live marks tiles with live cells. */
+	unsigned long *tiles_changed;
+	unsigned long *tiles_changed_next;
+	unsigned long *tiles_live;
+
+	/* amount of tiles calculated in the last generation */
+	unsigned int tiles_active;
+
+	/* Census of live cells, which is made by stepper from results of kernels, so field is
+	 * not scanned for it. Every tile has its population and box of live cells, every band
+	 * (row of tiles) has box of its live cells, and box of the board is their union.
+	 * Boxes are exact after generation, but cell changes only extend them. Births and
+	 * deaths are of the last generation step. Hash of the field is XOR of hashes of tiles,
+	 * it's kept up to date with the field. */
+	struct klife_tile_info *tiles_info;
+	struct klife_box *bands_box;
+	struct klife_box box;
+	u64 population;
+	u64 births, deaths;
+	u64 hash;
+
+	/* Cycle detection. Hashes of the last generations since the field was modified not by
+	 * stepper (history_count of them, protected by mutex). Period is non-zero when field
+	 * repeated one of them at generation period_gen (protected by lock). */
+	struct klife_cycle_entry history[KLIFE_CYCLE_HISTORY];
+	u64 history_count;
+	unsigned int period;
+	unsigned long long period_gen;
+
+	/* Box of tiles which are marked in tiles_changed (in tiles). Only this box extended by
+	 * one tile could have active tiles, so stepper doesn't look outside of it. */
+	struct klife_box changed;
+
+	/* amount of generations calculated */
+	unsigned long long generation;
 
-	/* proc parent */
+	/* Run thread of the board (exists only in KBM_RUN mode), target generation rate per
+	 * second (zero means 'as fast as possible') and rate achieved in the last second */
+	struct task_struct *thread;
+	unsigned int rate;
+	unsigned int rate_achieved;
+
+	/* Generation is split into threads stripes. First stripe is calculated by stepping
+	 * thread itself, others are queued to klife.wq, and stepping thread waits for them
+	 * before next generation is started. */
+	unsigned int threads;
+	struct klife_stripe *stripes;
+	atomic_t stripes_pending;
+	struct completion stripes_done;
+
+	/* Ring of the last finished generations, events_count is amount of them recorded
+	 * since creation (both are protected by lock). Readers of events file sleep on
+	 * events_wait until the next one. */
+	struct klife_gen_event events[KLIFE_EVENTS_RING];
+	u64 events_count;
+	wait_queue_head_t events_wait;
+
+	/* Delta stream, exists while its file is open (protected by mutex) */
+	struct klife_delta *delta;
+
+	/* HashLife node cache, created by first jump */
+	struct klife_hashlife *hashlife;
+
+	/* Latency histograms of phases, which are shown in debugfs */
+	struct klife_lat_hist lat[KLIFE_LAT_PHASES];
+
+	/* Viewport of board's dump (the whole board if it's empty) and its encoding, set by
+	 * proc view file (protected by lock) */
+	struct klife_box view;
+	int view_rle;
+
+	/* proc parent and debugfs file */
 	struct proc_dir_entry *proc_entry;
+	struct dentry *debug_entry;
 };
 
 
-int klife_create_board (char *name);
+int klife_create_board (char *name, struct klife_board_opts *opts);
+int klife_create_scratch_board (const struct klife_board_opts *opts, struct klife_board **board);
 int klife_delete_board (struct klife_board *board);
+struct klife_board *klife_find_board (int index);
+void klife_get_board (struct klife_board *board);
+void klife_put_board (struct klife_board *board);
 
 /* debug helpers */
 void klife_dump_board (struct klife_board *board);
@@ -79,7 +345,245 @@ int board_get_cell (struct klife_board *board, unsigned long x, unsigned long y)
 int board_set_cell (struct klife_board *board, unsigned long x, unsigned long y);
 int board_clear_cell (struct klife_board *board, unsigned long x, unsigned long y);
 int board_toggle_cell (struct klife_board *board, unsigned long x, unsigned long y);
+int board_apply_changes (struct klife_board *board, const struct klife_cell_change *changes,
+			 unsigned long n);
+void board_get_rect (struct klife_board *board, unsigned int x, unsigned int y,
+		     unsigned int w, unsigned int h, u8 *buf);
+int board_put_rect (struct klife_board *board, unsigned int x, unsigned int y,
+		    unsigned int w, unsigned int h, const u8 *buf);
+
+/* Life engine */
+int board_step (struct klife_board *board, unsigned long gens);
+int board_set_threads (struct klife_board *board, unsigned int threads);
+int board_jump (struct klife_board *board, unsigned int k);
+int board_set_rule (struct klife_board *board, const struct klife_rule *rule);
+
+/* Control device */
+int klife_dev_register (void);
+void klife_dev_unregister (void);
+
+/* Field mapping, generation events and delta stream */
+extern const struct file_operations klife_field_fops;
+extern const struct file_operations klife_events_fops;
+extern const struct file_operations klife_delta_fops;
+void board_delta_emit (struct klife_board *board, unsigned long long generation);
+
+/*
+ * Benchmark of the step engine. Scratch board of size WxH is filled with soup of given
+ * density (in percents) by PRNG seeded with seed, so the same spec gives the same
+ * generations on every run and release.
+ */
+#define KLIFE_BENCH_MAX_GENS 1000000
+
+struct klife_bench_spec {
+	struct klife_board_opts opts;
+	unsigned int density;
+	unsigned int gens, warmup;
+	unsigned int threads;
+	u64 seed;
+};
+
+struct klife_bench_result {
+	const char *kernel;
+	unsigned int width, height;
+	u64 total_ns, p50_ns, p99_ns;
+
+	/* cells calculated in all measured generations, and per second */
+	u64 cells, cells_rate;
+	u64 population;
+};
+
+void klife_bench_defaults (struct klife_bench_spec *spec);
+int klife_bench_run (const struct klife_bench_spec *spec, struct klife_bench_result *res);
+
+/* Debugfs */
+int klife_debug_init (void);
+void klife_debug_exit (void);
+void klife_debug_create_board (struct klife_board *board);
+void klife_debug_delete_board (struct klife_board *board);
+extern const char *klife_lat_names[KLIFE_LAT_PHASES];
+
+/* Run engine */
+int board_set_mode (struct klife_board *board, klife_board_mode_t mode);
+void board_set_rate (struct klife_board *board, unsigned int rate);
+void board_stop (struct klife_board *board);
 
 extern struct klife_status klife;
 
+
+/*
+ * Returns pointer to the word of field with cells X = wx*64 ... wx*64+63 of row Y. Words
+ * is amount of words in row.
+ */
+static inline u64 *__field_word (u64 *field, klife_board_layout_t layout, unsigned int words,
+				 unsigned int wx, unsigned int y)
+{
+	if (layout == KBL_TILED)
+		return field + (((unsigned long)(y >> KLIFE_TILE_SHIFT) * words + wx) << KLIFE_TILE_SHIFT) +
+			(y & (KLIFE_TILE_WORDS - 1));
+	return field + (unsigned long)y * words + wx;
+}
+
+
+static inline u64 *field_word (struct klife_board *board, u64 *field, unsigned int wx, unsigned int y)
+{
+	return __field_word (field, board->layout, board->field_width >> KLIFE_WORD_SHIFT, wx, y);
+}
+
+
+/* Pointer to first word of tile (tx, ty) of tiled field */
+static inline u64 *field_tile (struct klife_board *board, u64 *field, unsigned int tx, unsigned int ty)
+{
+	return field + (((unsigned long)ty * (board->field_width >> KLIFE_WORD_SHIFT) + tx) << KLIFE_TILE_SHIFT);
+}
+
+
+/* Amount of tiles of the field, which is the size of tile maps in bits */
+static inline unsigned int board_tiles (struct klife_board *board)
+{
+	return (board->field_width >> KLIFE_TILE_SHIFT) * (board->field_height >> KLIFE_TILE_SHIFT);
+}
+
+
+/* Bit of tile (tx, ty) in tile maps */
+static inline unsigned int board_tile_index (struct klife_board *board, unsigned int tx, unsigned int ty)
+{
+	return ty * (board->field_width >> KLIFE_TILE_SHIFT) + tx;
+}
+
+
+static inline int box_empty (const struct klife_box *box)
+{
+	return box->x0 >= box->x1 || box->y0 >= box->y1;
+}
+
+
+static inline void box_clear (struct klife_box *box)
+{
+	box->x0 = box->y0 = UINT_MAX;
+	box->x1 = box->y1 = 0;
+}
+
+
+/* Extend box to hold rectangle [x0, x1) x [y0, y1) */
+static inline void box_add (struct klife_box *box, unsigned int x0, unsigned int y0,
+			    unsigned int x1, unsigned int y1)
+{
+	box->x0 = min (box->x0, x0);
+	box->y0 = min (box->y0, y0);
+	box->x1 = max (box->x1, x1);
+	box->y1 = max (box->y1, y1);
+}
+
+
+static inline void box_union (struct klife_box *box, const struct klife_box *other)
+{
+	if (!box_empty (other))
+		box_add (box, other->x0, other->y0, other->x1, other->y1);
+}
+
+
+/*
+ * Field changes visible to mapping readers must be made between these calls, with board's
+ * lock held for write. End publishes the new state of the field in mapping header.
+ */
+static inline void board_frame_begin (struct klife_board *board)
+{
+	write_seqcount_begin (&board->seq);
+	board->header->seq++;
+	smp_wmb ();
+}
+
+
+static inline void board_frame_end (struct klife_board *board)
+{
+	struct klife_mmap_header *hdr = board->header;
+
+	hdr->generation = board->generation;
+	hdr->field_side = board->field_width;
+	hdr->field_height = board->field_height;
+	hdr->side = board->side;
+	hdr->layout = board->layout;
+	hdr->topology = board->topology;
+	hdr->cur_buffer = board->field == board->buffers[1];
+	hdr->buffer_size = board->field ? PAGE_SIZE << board->pages_power : 0;
+
+	smp_wmb ();
+	hdr->seq++;
+	write_seqcount_end (&board->seq);
+}
+
+
+/*
+ * Lockless read of the field:
+ *
+ *	rcu_read_lock ();
+ *	do {
+ *		seq = board_read_begin (board);
+ *		... read field ...
+ *	} while (board_read_retry (board, seq));
+ *	rcu_read_unlock ();
+ *
+ * Results read inside of loop must not be used until retry returns false, because field
+ * could be changed (and even reallocated) in the middle.
+ */
+static inline unsigned int board_read_begin (struct klife_board *board)
+{
+	return read_seqcount_begin (&board->seq);
+}
+
+
+static inline int board_read_retry (struct klife_board *board, unsigned int seq)
+{
+	return read_seqcount_retry (&board->seq, seq);
+}
+
+
+/*
+ * Account time passed since start in histogram of phase.
+ *
+ * Returns the time in ns.
+ */
+static inline u64 board_lat_add (struct klife_board *board, klife_lat_phase_t phase, ktime_t start)
+{
+	struct klife_lat_hist *hist = &board->lat[phase];
+	s64 ns = ktime_to_ns (ktime_sub (ktime_get (), start));
+	unsigned int bucket;
+
+	if (ns < 0)
+		ns = 0;
+	bucket = min_t (unsigned int, ns ? fls64 (ns) - 1 : 0, KLIFE_LAT_BUCKETS - 1);
+
+	atomic64_inc (&hist->count);
+	atomic64_add (ns, &hist->sum_ns);
+	atomic64_inc (&hist->buckets[bucket]);
+	return ns;
+}
+
+
+/* Take board's lock for write, time of wait is accounted */
+static inline void board_write_lock (struct klife_board *board)
+{
+	ktime_t start = ktime_get ();
+
+	write_lock (&board->lock);
+	board_lat_add (board, KLIFE_LAT_LOCK, start);
+}
+
+
+/*
+ * Record finished generation in events ring and wake up its readers. Must be called with
+ * board's lock held for write, after the field is published.
+ */
+static inline void board_generation_done (struct klife_board *board)
+{
+	struct klife_gen_event *ev = &board->events[board->events_count & (KLIFE_EVENTS_RING - 1)];
+
+	ev->generation = board->generation;
+	ev->time_ns = ktime_to_ns (ktime_get ());
+	board->events_count++;
+
+	wake_up_interruptible (&board->events_wait);
+}
+
 #endif
@@ -0,0 +1,23 @@
+#!/bin/sh
+
+B=/proc/klife/boards/0
+
+set -x
+
+rmmod klife
+insmod ~/klife.ko
+
+echo test > /proc/klife/boards/create
+
+# blinker
+cat > $B/board <<EOF2
+set 1 0
+set 1 1
+set 1 2
+EOF2
+
+cat $B/board
+echo 1 > $B/step
+cat $B/board
+echo 1 > $B/step
+cat $B/board
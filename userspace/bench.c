@@ -0,0 +1,190 @@
+#include <getopt.h>
+
+#include "kshim.h"
+
+#include "klife.h"
+
+
+/*
+ * Benchmark of the core. Generations are measured by klife_bench_run, the same as
+ * /proc/klife/bench does, so results are comparable with the module. Optionally, enlarge
+ * of plane field is measured for growing sides.
+ */
+
+
+static void usage (const char *prog)
+{
+	fprintf (stderr,
+		 "Usage: %s [options]\n"
+		 "  -s SIDE      side of the board in cells, multiple of 64 unless plane (1024)\n"
+		 "  -t TOPOLOGY  plane, bounded or torus (torus)\n"
+		 "  -l LAYOUT    linear or tiled (linear)\n"
+		 "  -r RULE      rule in B/S notation (B3/S23)\n"
+		 "  -d DENSITY   percent of live cells in soup (35)\n"
+		 "  -g GENS      generations to measure (1000)\n"
+		 "  -w GENS      generations before measurement (10)\n"
+		 "  -T THREADS   workers of the board (1)\n"
+		 "  -S SEED      seed of soup (1)\n"
+		 "  -p NAME=VAL  set module parameter (step_kernel, field_vmalloc)\n"
+		 "  -e SIDE      measure enlarge of plane field up to SIDE\n",
+		 prog);
+	exit (1);
+}
+
+
+static void bench_step (const struct klife_bench_spec *spec)
+{
+	struct klife_bench_result res;
+	char rule[KLIFE_RULE_MAX];
+	int ret;
+
+	ret = klife_bench_run (spec, &res);
+	if (ret) {
+		fprintf (stderr, "Benchmark failed: %s\n", strerror (-ret));
+		exit (1);
+	}
+
+	klife_rule_format (&spec->opts.rule, rule, sizeof (rule));
+
+	printf ("Board:\t\t%ux%u %s %s %s, %u threads\n", res.width, res.height,
+		spec->opts.topology == KBT_PLANE ? "plane" :
+		spec->opts.topology == KBT_BOUNDED ? "bounded" : "torus",
+		spec->opts.layout == KBL_TILED ? "tiled" : "linear", rule, spec->threads);
+	printf ("Generations:\t%u in %.3f s\n", spec->gens, res.total_ns / 1e9);
+	printf ("Per generation:\tavg %llu ns, p50 %llu ns, p99 %llu ns\n",
+		res.total_ns / spec->gens, res.p50_ns, res.p99_ns);
+	printf ("Rate:\t\t%.1f gens/s, %.3g cells/s\n", spec->gens * 1e9 / res.total_ns,
+		res.cells * 1e9 / res.total_ns);
+	printf ("Population:\t%llu\n", res.population);
+}
+
+
+/*
+ * Plane field is enlarged by setting cell outside of it, every time to twice the side.
+ * One live cell is set before, so copy of old field isn't skipped.
+ */
+static void bench_enlarge (const struct klife_bench_spec *spec, unsigned int max_side)
+{
+	struct klife_board_opts opts = { .layout = KBL_LINEAR, .topology = KBT_PLANE };
+	struct klife_board *board;
+	unsigned int side;
+	ktime_t start;
+	u64 ns;
+	int ret;
+
+	klife_rule_conway (&opts.rule);
+	ret = klife_create_scratch_board (&opts, &board);
+	if (!ret)
+		ret = board_set_threads (board, spec->threads);
+	if (ret) {
+		fprintf (stderr, "Failed to create board: %s\n", strerror (-ret));
+		exit (1);
+	}
+	board_set_cell (board, 63, 63);
+
+	for (side = board->field_width; side < max_side; side = board->field_width) {
+		start = ktime_get ();
+		if (board_set_cell (board, side * 2 - 1, 0)) {
+			fprintf (stderr, "Failed to enlarge field of side %u\n", side);
+			break;
+		}
+		ns = ktime_to_ns (ktime_sub (ktime_get (), start));
+		printf ("Enlarge:\t%u -> %u, %llu pages%s, alloc %llu ns, total %llu ns\n", side,
+			board->field_width, 1ULL << board->pages_power,
+			board->field_vmapped ? " (vmalloc)" : "",
+			board->alloc_ns, ns);
+	}
+
+	klife_put_board (board);
+}
+
+
+int main (int argc, char **argv)
+{
+	struct klife_bench_spec spec;
+	unsigned int enlarge = 0;
+	char report[1024], *val;
+	int opt, ret;
+
+	klife_bench_defaults (&spec);
+
+	while ((opt = getopt (argc, argv, "s:t:l:r:d:g:w:T:S:p:e:")) != -1) {
+		switch (opt) {
+		case 's':
+			spec.opts.width = spec.opts.height = strtoul (optarg, NULL, 0);
+			break;
+		case 't':
+			if (!strcmp (optarg, "plane"))
+				spec.opts.topology = KBT_PLANE;
+			else if (!strcmp (optarg, "bounded"))
+				spec.opts.topology = KBT_BOUNDED;
+			else if (!strcmp (optarg, "torus"))
+				spec.opts.topology = KBT_TORUS;
+			else
+				usage (argv[0]);
+			break;
+		case 'l':
+			if (!strcmp (optarg, "linear"))
+				spec.opts.layout = KBL_LINEAR;
+			else if (!strcmp (optarg, "tiled"))
+				spec.opts.layout = KBL_TILED;
+			else
+				usage (argv[0]);
+			break;
+		case 'r':
+			if (klife_rule_parse (optarg, &spec.opts.rule))
+				usage (argv[0]);
+			break;
+		case 'd':
+			spec.density = strtoul (optarg, NULL, 0);
+			break;
+		case 'g':
+			spec.gens = strtoul (optarg, NULL, 0);
+			break;
+		case 'w':
+			spec.warmup = strtoul (optarg, NULL, 0);
+			break;
+		case 'T':
+			spec.threads = strtoul (optarg, NULL, 0);
+			break;
+		case 'S':
+			spec.seed = strtoull (optarg, NULL, 0);
+			break;
+		case 'p':
+			val = strchr (optarg, '=');
+			if (!val)
+				usage (argv[0]);
+			*val++ = 0;
+			if (kshim_param_set (optarg, val)) {
+				fprintf (stderr, "Bad module parameter %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'e':
+			enlarge = strtoul (optarg, NULL, 0);
+			break;
+		default:
+			usage (argv[0]);
+		}
+	}
+
+	if (!spec.opts.width || !spec.gens || spec.gens > KLIFE_BENCH_MAX_GENS ||
+	    spec.density > 100 || !spec.threads || spec.threads > KLIFE_MAX_THREADS)
+		usage (argv[0]);
+
+	ret = kshim_init ();
+	if (ret) {
+		fprintf (stderr, "Failed to initialize: %s\n", strerror (-ret));
+		return 1;
+	}
+
+	klife_step_report (report, sizeof (report));
+	printf ("%s", report);
+
+	bench_step (&spec);
+	if (enlarge)
+		bench_enlarge (&spec, enlarge);
+
+	kshim_exit ();
+	return 0;
+}
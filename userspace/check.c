@@ -0,0 +1,230 @@
+#include <getopt.h>
+
+#include "kshim.h"
+
+#include "klife.h"
+#include "klife-hash.h"
+
+
+/*
+ * Agreement check of the engines. Seeded soup is calculated by every usable implementation
+ * of step kernels, in both layouts and by one and several workers, and by HashLife jump on
+ * plane. Result must be the same as of the reference: portable u64 kernels on linear
+ * board by one worker. Field, population and hash are compared.
+ */
+
+/* soup is put at this offset of plane, so it doesn't reach negative coordinates */
+#define SOUP_ORIGIN	256
+#define SOUP_SIDE	128
+
+/* side of torus board, all of it is soup */
+#define TORUS_SIDE	256
+
+/* soup grows by one cell per generation at most, so 2^7 generations keep it at the plane */
+#define JUMP_MAX	7
+
+static const char * const kernels[] = { "u64", "sse2", "avx2", "avx512" };
+static const char * const rules[] = { "B3/S23", "B36/S23", "B2/S", "B3678/S34678", "B35678/S5678" };
+static const unsigned int threads[] = { 1, 4 };
+
+static unsigned long long seed = 1;
+static unsigned int gens = 100, jump = 6;
+static int failed;
+
+
+static void usage (const char *prog)
+{
+	fprintf (stderr,
+		 "Usage: %s [options]\n"
+		 "  -g GENS      generations to step (100)\n"
+		 "  -k K         jump by 2^K generations by HashLife (6), at most %u\n"
+		 "  -S SEED      seed of soup (1)\n",
+		 prog, JUMP_MAX);
+	exit (1);
+}
+
+
+/* xorshift64*, the same soup for every seed on every machine */
+static u64 soup_next (u64 *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
+
+
+static struct klife_board *create_board (const char *rule, klife_board_layout_t layout,
+					 klife_board_topology_t topology, unsigned int workers)
+{
+	struct klife_board_opts opts = { .layout = layout, .topology = topology };
+	unsigned int side = topology == KBT_PLANE ? SOUP_SIDE : TORUS_SIDE;
+	unsigned int pos = topology == KBT_PLANE ? SOUP_ORIGIN : 0;
+	u64 state = seed ? seed : 1, *soup;
+	struct klife_board *board;
+	unsigned int i;
+	int ret;
+
+	klife_rule_parse (rule, &opts.rule);
+	if (topology != KBT_PLANE)
+		opts.width = opts.height = TORUS_SIDE;
+
+	soup = malloc (side * side / 8);
+	for (i = 0; i < side * side / 64; i++)
+		soup[i] = soup_next (&state);
+
+	ret = klife_create_scratch_board (&opts, &board);
+	if (!ret)
+		ret = board_set_threads (board, workers);
+	if (!ret)
+		ret = board_put_rect (board, pos, pos, side, side, (u8 *)soup);
+	free (soup);
+
+	if (ret) {
+		fprintf (stderr, "Failed to create board: %s\n", strerror (-ret));
+		exit (1);
+	}
+
+	return board;
+}
+
+
+static int select_kernels (const char *name)
+{
+	if (kshim_param_set ("step_kernel", name))
+		return -EINVAL;
+	return klife_step_select ();
+}
+
+
+/* Compare board with the reference, cells outside of smaller field are dead */
+static void compare (const char *what, struct klife_board *ref, struct klife_board *board)
+{
+	unsigned int w = max (ref->field_width, board->field_width);
+	unsigned int h = max (ref->field_height, board->field_height);
+	size_t size = (size_t)DIV_ROUND_UP (w, 8) * h;
+	u8 *a = malloc (size), *b = malloc (size);
+	const char *diff = NULL;
+
+	board_get_rect (ref, 0, 0, w, h, a);
+	board_get_rect (board, 0, 0, w, h, b);
+
+	if (ref->generation != board->generation)
+		diff = "generation";
+	else if (ref->population != board->population)
+		diff = "population";
+	else if (ref->hash != board->hash)
+		diff = "hash";
+	else if (memcmp (a, b, size))
+		diff = "field";
+
+	printf ("%-60s %s%s\n", what, diff ? "FAILED, differs by " : "ok", diff ? diff : "");
+	if (diff)
+		failed = 1;
+
+	free (a);
+	free (b);
+}
+
+
+static void check_step (const char *rule, klife_board_topology_t topology)
+{
+	struct klife_board *ref, *board;
+	unsigned int k, l, t;
+	char what[128];
+
+	select_kernels (kernels[0]);
+	ref = create_board (rule, KBL_LINEAR, topology, 1);
+	board_step (ref, gens);
+
+	for (k = 0; k < ARRAY_SIZE (kernels); k++) {
+		if (select_kernels (kernels[k])) {
+			printf ("%s step kernels are not usable, skipped\n", kernels[k]);
+			continue;
+		}
+
+		for (l = 0; l < 2; l++)
+			for (t = 0; t < ARRAY_SIZE (threads); t++) {
+				board = create_board (rule, l ? KBL_TILED : KBL_LINEAR, topology, threads[t]);
+				board_step (board, gens);
+				snprintf (what, sizeof (what), "%s %s step %u: %s %s, %u threads", rule,
+					  topology == KBT_PLANE ? "plane" : "torus", gens, kernels[k],
+					  l ? "tiled" : "linear", threads[t]);
+				compare (what, ref, board);
+				klife_put_board (board);
+			}
+	}
+
+	klife_put_board (ref);
+}
+
+
+static void check_jump (const char *rule)
+{
+	struct klife_board *ref, *board;
+	char what[128];
+	unsigned int l;
+	int ret;
+
+	select_kernels (kernels[0]);
+	ref = create_board (rule, KBL_LINEAR, KBT_PLANE, 1);
+	board_step (ref, 1UL << jump);
+
+	for (l = 0; l < 2; l++) {
+		board = create_board (rule, l ? KBL_TILED : KBL_LINEAR, KBT_PLANE, 1);
+		ret = board_jump (board, jump);
+		snprintf (what, sizeof (what), "%s plane jump 2^%u: %s", rule, jump,
+			  l ? "tiled" : "linear");
+		if (ret) {
+			printf ("%-60s FAILED, error %d\n", what, ret);
+			failed = 1;
+		} else
+			compare (what, ref, board);
+		klife_put_board (board);
+	}
+
+	klife_put_board (ref);
+}
+
+
+int main (int argc, char **argv)
+{
+	unsigned int r;
+	int opt, ret;
+
+	while ((opt = getopt (argc, argv, "g:k:S:")) != -1) {
+		switch (opt) {
+		case 'g':
+			gens = strtoul (optarg, NULL, 0);
+			break;
+		case 'k':
+			jump = strtoul (optarg, NULL, 0);
+			break;
+		case 'S':
+			seed = strtoull (optarg, NULL, 0);
+			break;
+		default:
+			usage (argv[0]);
+		}
+	}
+
+	if (!gens || jump > JUMP_MAX)
+		usage (argv[0]);
+
+	ret = kshim_init ();
+	if (ret) {
+		fprintf (stderr, "Failed to initialize: %s\n", strerror (-ret));
+		return 1;
+	}
+
+	for (r = 0; r < ARRAY_SIZE (rules); r++) {
+		check_step (rules[r], KBT_PLANE);
+		check_step (rules[r], KBT_TORUS);
+		check_jump (rules[r]);
+	}
+
+	kshim_exit ();
+
+	printf ("%s\n", failed ? "FAILED" : "All engines agree");
+	return failed;
+}
@@ -0,0 +1,441 @@
+#include <time.h>
+#include <unistd.h>
+
+#include "kshim.h"
+
+#include "klife.h"
+#include "klife-proc.h"
+#include "klife-hash.h"
+
+
+/*
+ * Implementation of kshim.h, and parts of the module which are not built in userspace:
+ * module init, /proc interface, run threads and delta stream.
+ */
+
+
+struct klife_status klife;
+int kshim_verbose;
+
+
+/*
+ * Module parameters
+ */
+#define PARAMS_MAX 32
+
+static struct kshim_param {
+	const char *name;
+	void *ptr;
+	enum kshim_param_type type;
+
+	/* string of charp parameter was set by kshim_param_set, it's freed by the next one */
+	char *str;
+} params[PARAMS_MAX];
+
+static unsigned int params_count;
+
+
+void kshim_param_add (const char *name, void *ptr, enum kshim_param_type type)
+{
+	BUG_ON (params_count >= PARAMS_MAX);
+	params[params_count].name = name;
+	params[params_count].ptr = ptr;
+	params[params_count].type = type;
+	params_count++;
+}
+
+
+/*
+ * Set module parameter by name from string, as insmod does.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int kshim_param_set (const char *name, const char *value)
+{
+	struct kshim_param *p;
+	unsigned int i;
+	char *end;
+	long val;
+
+	for (i = 0; i < params_count; i++)
+		if (!strcmp (params[i].name, name))
+			break;
+	if (i == params_count)
+		return -ENOENT;
+	p = &params[i];
+
+	if (p->type == kshim_param_charp) {
+		free (p->str);
+		p->str = strdup (value);
+		*(char **)p->ptr = p->str;
+		return 0;
+	}
+
+	val = strtol (value, &end, 0);
+	if (!*value || *end)
+		return -EINVAL;
+
+	switch (p->type) {
+	case kshim_param_bool:
+		*(bool *)p->ptr = !!val;
+		break;
+	case kshim_param_uint:
+		*(unsigned int *)p->ptr = val;
+		break;
+	case kshim_param_ulong:
+		*(unsigned long *)p->ptr = val;
+		break;
+	default:
+		*(int *)p->ptr = val;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Pages
+ */
+unsigned long __get_free_pages (int flags, unsigned int order)
+{
+	void *ptr;
+
+	if (order >= MAX_ORDER || posix_memalign (&ptr, PAGE_SIZE, PAGE_SIZE << order))
+		return 0;
+	if (flags & __GFP_ZERO)
+		memset (ptr, 0, PAGE_SIZE << order);
+	return (unsigned long)ptr;
+}
+
+
+void free_pages (unsigned long addr, unsigned int order)
+{
+	free ((void *)addr);
+}
+
+
+unsigned long get_zeroed_page (int flags)
+{
+	return __get_free_pages (flags | __GFP_ZERO, 0);
+}
+
+
+void free_page (unsigned long addr)
+{
+	free ((void *)addr);
+}
+
+
+/* vmalloc'ed blocks, there are at most two field buffers of every board */
+#define VMALLOC_MAX 64
+
+static const void *vmalloc_blocks[VMALLOC_MAX];
+static pthread_mutex_t vmalloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+void *vmalloc (unsigned long size)
+{
+	void *ptr;
+	unsigned int i;
+
+	if (posix_memalign (&ptr, PAGE_SIZE, size))
+		return NULL;
+
+	pthread_mutex_lock (&vmalloc_lock);
+	for (i = 0; i < VMALLOC_MAX; i++)
+		if (!vmalloc_blocks[i]) {
+			vmalloc_blocks[i] = ptr;
+			break;
+		}
+	pthread_mutex_unlock (&vmalloc_lock);
+
+	if (i == VMALLOC_MAX) {
+		free (ptr);
+		return NULL;
+	}
+	return ptr;
+}
+
+
+void vfree (const void *addr)
+{
+	unsigned int i;
+
+	if (!addr)
+		return;
+
+	pthread_mutex_lock (&vmalloc_lock);
+	for (i = 0; i < VMALLOC_MAX; i++)
+		if (vmalloc_blocks[i] == addr)
+			vmalloc_blocks[i] = NULL;
+	pthread_mutex_unlock (&vmalloc_lock);
+
+	free ((void *)addr);
+}
+
+
+int is_vmalloc_addr (const void *addr)
+{
+	unsigned int i;
+	int ret = 0;
+
+	pthread_mutex_lock (&vmalloc_lock);
+	for (i = 0; i < VMALLOC_MAX && !ret; i++)
+		ret = addr && vmalloc_blocks[i] == addr;
+	pthread_mutex_unlock (&vmalloc_lock);
+
+	return ret;
+}
+
+
+struct kmem_cache *kmem_cache_create (const char *name, size_t size, size_t align,
+				     unsigned long flags, void (*ctor) (void *))
+{
+	struct kmem_cache *cache = malloc (sizeof (*cache));
+
+	if (cache)
+		cache->size = size;
+	return cache;
+}
+
+
+void kmem_cache_destroy (struct kmem_cache *cache)
+{
+	free (cache);
+}
+
+
+/*
+ * Time and random
+ */
+ktime_t ktime_get (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (ktime_t) { (s64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec };
+}
+
+
+void get_random_bytes (void *buf, int nbytes)
+{
+	static u64 state = 0x853c49e6748fea9bULL;
+	u8 *p = buf;
+
+	/* only benchmark of step kernels uses it, so it's not random at all */
+	while (nbytes--) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		*p++ = state;
+	}
+}
+
+
+/*
+ * Workqueue. Every queue has threads by amount of CPUs, which take works from its list.
+ */
+struct workqueue_struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct work_struct *head, *tail;
+	int stop;
+	unsigned int threads;
+	pthread_t *thread;
+};
+
+
+static void *worker_thread (void *data)
+{
+	struct workqueue_struct *wq = data;
+	struct work_struct *work;
+
+	pthread_mutex_lock (&wq->lock);
+	while (1) {
+		while (!wq->head && !wq->stop)
+			pthread_cond_wait (&wq->cond, &wq->lock);
+		if (!wq->head)
+			break;
+
+		work = wq->head;
+		wq->head = work->next;
+		if (!wq->head)
+			wq->tail = NULL;
+
+		pthread_mutex_unlock (&wq->lock);
+		work->func (work);
+		pthread_mutex_lock (&wq->lock);
+	}
+	pthread_mutex_unlock (&wq->lock);
+
+	return NULL;
+}
+
+
+struct workqueue_struct *alloc_workqueue (const char *name, unsigned int flags, int max_active)
+{
+	struct workqueue_struct *wq;
+	long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+	unsigned int i;
+
+	wq = calloc (1, sizeof (*wq));
+	if (!wq)
+		return NULL;
+
+	wq->threads = max (cpus, 1L);
+	wq->thread = calloc (wq->threads, sizeof (pthread_t));
+	if (!wq->thread) {
+		free (wq);
+		return NULL;
+	}
+
+	pthread_mutex_init (&wq->lock, NULL);
+	pthread_cond_init (&wq->cond, NULL);
+	for (i = 0; i < wq->threads; i++)
+		pthread_create (&wq->thread[i], NULL, worker_thread, wq);
+
+	return wq;
+}
+
+
+/* Works which are queued already are finished before queue is destroyed */
+void destroy_workqueue (struct workqueue_struct *wq)
+{
+	unsigned int i;
+
+	pthread_mutex_lock (&wq->lock);
+	wq->stop = 1;
+	pthread_cond_broadcast (&wq->cond);
+	pthread_mutex_unlock (&wq->lock);
+
+	for (i = 0; i < wq->threads; i++)
+		pthread_join (wq->thread[i], NULL);
+
+	free (wq->thread);
+	free (wq);
+}
+
+
+int queue_work (struct workqueue_struct *wq, struct work_struct *work)
+{
+	pthread_mutex_lock (&wq->lock);
+	work->next = NULL;
+	if (wq->tail)
+		wq->tail->next = work;
+	else
+		wq->head = work;
+	wq->tail = work;
+	pthread_cond_signal (&wq->cond);
+	pthread_mutex_unlock (&wq->lock);
+
+	return 1;
+}
+
+
+void init_completion (struct completion *x)
+{
+	pthread_mutex_init (&x->lock, NULL);
+	pthread_cond_init (&x->cond, NULL);
+	x->done = 0;
+}
+
+
+void complete (struct completion *x)
+{
+	pthread_mutex_lock (&x->lock);
+	x->done++;
+	pthread_cond_signal (&x->cond);
+	pthread_mutex_unlock (&x->lock);
+}
+
+
+void wait_for_completion (struct completion *x)
+{
+	pthread_mutex_lock (&x->lock);
+	while (!x->done)
+		pthread_cond_wait (&x->cond, &x->lock);
+	x->done--;
+	pthread_mutex_unlock (&x->lock);
+}
+
+
+/*
+ * Parts of the module which are not built. Boards have no proc entries, are never run by
+ * threads, and have no delta stream.
+ */
+int proc_create_board (struct klife_board *board)
+{
+	return 0;
+}
+
+
+int proc_delete_board (struct klife_board *board)
+{
+	return 0;
+}
+
+
+void board_stop (struct klife_board *board)
+{
+}
+
+
+void board_delta_emit (struct klife_board *board, unsigned long long generation)
+{
+}
+
+
+void klife_debug_create_board (struct klife_board *board)
+{
+}
+
+
+void klife_debug_delete_board (struct klife_board *board)
+{
+}
+
+
+/*
+ * Initialize the core as klife_init does. Module parameters must be set before.
+ *
+ * Return 0 if succeeded, -ERROR otherwise.
+ */
+int kshim_init (void)
+{
+	kshim_verbose = getenv ("KLIFE_VERBOSE") != NULL;
+
+	klife.lock = RW_LOCK_UNLOCKED;
+	INIT_LIST_HEAD (&klife.boards);
+
+	klife.wq = alloc_workqueue ("klife", WQ_UNBOUND | WQ_HIGHPRI, 0);
+	if (!klife.wq)
+		return -ENOMEM;
+
+	if (hashlife_init ()) {
+		destroy_workqueue (klife.wq);
+		return -ENOMEM;
+	}
+
+	if (klife_step_select ()) {
+		hashlife_exit ();
+		destroy_workqueue (klife.wq);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+/* Delete all boards and free what kshim_init allocated */
+void kshim_exit (void)
+{
+	struct klife_board *board;
+
+	while (!list_empty (&klife.boards)) {
+		board = list_entry (klife.boards.next, struct klife_board, next);
+		klife_delete_board (board);
+	}
+
+	hashlife_exit ();
+	destroy_workqueue (klife.wq);
+}
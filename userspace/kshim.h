@@ -0,0 +1,686 @@
+#ifndef __KSHIM_H__
+#define __KSHIM_H__
+
+/*
+ * Kernel API used by klife core, implemented on top of libc and pthreads.
+ *
+ * Core sources are compiled here without changes: every kernel header they include
+ * (linux/slab.h, asm/i387.h and so on) is generated by Makefile and includes only this
+ * file. Only things which core really uses are here, and they are made as simple as
+ * possible: locks are pthread locks, pages are aligned heap blocks, RCU readers are
+ * never concurrent with writers (benchmark has no lockless readers), so grace period
+ * is empty.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+
+/*
+ * Types and compiler
+ */
+/* 64-bit types are long long, as in the kernel, so formats are the same */
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+
+typedef u8 __u8;
+typedef u16 __u16;
+typedef u32 __u32;
+typedef u64 __u64;
+typedef s32 __s32;
+typedef s64 __s64;
+
+#define __user
+#define __init
+#define __exit
+#ifndef __always_inline
+#define __always_inline inline __attribute__ ((always_inline))
+#endif
+
+#define likely(x)	__builtin_expect (!!(x), 1)
+#define unlikely(x)	__builtin_expect (!!(x), 0)
+
+#define ARRAY_SIZE(a) (sizeof (a) / sizeof ((a)[0]))
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof (type, member)))
+
+#define BUG_ON(cond)								\
+	do {									\
+		if (unlikely (cond)) {						\
+			fprintf (stderr, "BUG at %s:%d\n", __FILE__, __LINE__);	\
+			abort ();						\
+		}								\
+	} while (0)
+#define WARN_ON(cond) ({ int __c = !!(cond); if (unlikely (__c)) fprintf (stderr, "WARNING at %s:%d\n", __FILE__, __LINE__); __c; })
+
+
+/*
+ * linux/kernel.h
+ */
+#define min(a, b) ({ typeof (a) __a = (a); typeof (b) __b = (b); __a < __b ? __a : __b; })
+#define max(a, b) ({ typeof (a) __a = (a); typeof (b) __b = (b); __a > __b ? __a : __b; })
+#define min_t(type, a, b) min ((type)(a), (type)(b))
+#define max_t(type, a, b) max ((type)(a), (type)(b))
+#define swap(a, b) do { typeof (a) __t = (a); (a) = (b); (b) = __t; } while (0)
+
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define ALIGN(x, a) (((x) + (a) - 1) & ~((typeof (x))(a) - 1))
+
+#define U32_MAX 0xffffffffU
+
+/* messages are shown only if KLIFE_VERBOSE is set in environment, level prefix is empty */
+#define KERN_ERR	""
+#define KERN_WARNING	""
+#define KERN_INFO	""
+#define KERN_DEBUG	""
+
+extern int kshim_verbose;
+#define printk(fmt...) do { if (kshim_verbose) fprintf (stderr, fmt); } while (0)
+#define pr_debug(fmt...) do { } while (0)
+
+static inline unsigned long simple_strtoul (const char *cp, char **endp, unsigned int base)
+{
+	return strtoul (cp, endp, base);
+}
+
+
+static inline long simple_strtol (const char *cp, char **endp, unsigned int base)
+{
+	return strtol (cp, endp, base);
+}
+
+
+/*
+ * linux/module.h. Parameters are registered by name, so they could be set by
+ * kshim_param_set before kshim_init.
+ */
+enum kshim_param_type {
+	kshim_param_int,
+	kshim_param_uint,
+	kshim_param_ulong,
+	kshim_param_bool,
+	kshim_param_charp,
+};
+
+extern void kshim_param_add (const char *name, void *ptr, enum kshim_param_type type);
+extern int kshim_param_set (const char *name, const char *value);
+
+#define module_param(name, type, perm)						\
+	static void __attribute__ ((constructor)) __kshim_param_##name (void)	\
+	{									\
+		kshim_param_add (#name, &name, kshim_param_##type);		\
+	}
+#define MODULE_PARM_DESC(name, desc)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define EXPORT_SYMBOL(x)
+#define THIS_MODULE NULL
+
+
+/*
+ * Bit operations and bitmaps
+ */
+#define BITS_PER_LONG	(sizeof (long) * 8)
+#define BITS_TO_LONGS(n) DIV_ROUND_UP (n, BITS_PER_LONG)
+#define BIT_WORD(n)	((n) / BITS_PER_LONG)
+#define BIT_MASK(n)	(1UL << ((n) % BITS_PER_LONG))
+
+static inline int fls64 (u64 x)
+{
+	return x ? 64 - __builtin_clzll (x) : 0;
+}
+
+
+static inline unsigned long __ffs64 (u64 x)
+{
+	return __builtin_ctzll (x);
+}
+
+
+static inline unsigned int hweight64 (u64 x)
+{
+	return __builtin_popcountll (x);
+}
+
+
+#define ilog2(n) (63 - __builtin_clzll (n))
+
+static inline unsigned long roundup_pow_of_two (unsigned long n)
+{
+	return n > 1 ? 1UL << (64 - __builtin_clzl (n - 1)) : 1;
+}
+
+
+static inline void set_bit (long nr, unsigned long *addr)
+{
+	__atomic_or_fetch (&addr[BIT_WORD (nr)], BIT_MASK (nr), __ATOMIC_RELAXED);
+}
+
+
+static inline void clear_bit (long nr, unsigned long *addr)
+{
+	__atomic_and_fetch (&addr[BIT_WORD (nr)], ~BIT_MASK (nr), __ATOMIC_RELAXED);
+}
+
+
+static inline void __set_bit (long nr, unsigned long *addr)
+{
+	addr[BIT_WORD (nr)] |= BIT_MASK (nr);
+}
+
+
+static inline void __clear_bit (long nr, unsigned long *addr)
+{
+	addr[BIT_WORD (nr)] &= ~BIT_MASK (nr);
+}
+
+
+static inline int test_bit (long nr, const unsigned long *addr)
+{
+	return (addr[BIT_WORD (nr)] >> (nr % BITS_PER_LONG)) & 1;
+}
+
+
+static inline void bitmap_zero (unsigned long *dst, long nbits)
+{
+	memset (dst, 0, BITS_TO_LONGS (nbits) * sizeof (long));
+}
+
+
+static inline void bitmap_fill (unsigned long *dst, long nbits)
+{
+	memset (dst, 0xff, BITS_TO_LONGS (nbits) * sizeof (long));
+}
+
+
+static inline int bitmap_weight (const unsigned long *src, long nbits)
+{
+	long i, w = 0;
+
+	for (i = 0; i < nbits / (long)BITS_PER_LONG; i++)
+		w += __builtin_popcountl (src[i]);
+	if (nbits % BITS_PER_LONG)
+		w += __builtin_popcountl (src[i] & (BIT_MASK (nbits) - 1));
+	return w;
+}
+
+
+static inline unsigned long find_next_bit (const unsigned long *addr, unsigned long size,
+					   unsigned long offset)
+{
+	unsigned long w;
+
+	while (offset < size) {
+		w = addr[BIT_WORD (offset)] >> (offset % BITS_PER_LONG);
+		if (w)
+			return min (offset + __builtin_ctzl (w), size);
+		offset = (offset | (BITS_PER_LONG - 1)) + 1;
+	}
+	return size;
+}
+
+
+/*
+ * Memory. Pages are aligned heap blocks, vmalloc'ed blocks are remembered to answer
+ * is_vmalloc_addr.
+ */
+#define PAGE_SHIFT	12
+#define PAGE_SIZE	(1UL << PAGE_SHIFT)
+#define MAX_ORDER	11
+
+#define GFP_KERNEL	0x01
+#define GFP_ATOMIC	0x02
+#define __GFP_ZERO	0x100
+#define __GFP_NOWARN	0x200
+#define __GFP_NORETRY	0x400
+
+static inline void *kmalloc (size_t size, int flags)
+{
+	return flags & __GFP_ZERO ? calloc (1, size ? size : 1) : malloc (size ? size : 1);
+}
+
+
+static inline void *kzalloc (size_t size, int flags)
+{
+	return calloc (1, size ? size : 1);
+}
+
+
+static inline void *kcalloc (size_t n, size_t size, int flags)
+{
+	return calloc (n ? n : 1, size ? size : 1);
+}
+
+
+static inline void kfree (const void *ptr)
+{
+	free ((void *)ptr);
+}
+
+
+extern unsigned long __get_free_pages (int flags, unsigned int order);
+extern void free_pages (unsigned long addr, unsigned int order);
+extern unsigned long get_zeroed_page (int flags);
+extern void free_page (unsigned long addr);
+extern void *vmalloc (unsigned long size);
+extern void vfree (const void *addr);
+extern int is_vmalloc_addr (const void *addr);
+
+struct kmem_cache {
+	size_t size;
+};
+
+extern struct kmem_cache *kmem_cache_create (const char *name, size_t size, size_t align,
+					     unsigned long flags, void (*ctor) (void *));
+extern void kmem_cache_destroy (struct kmem_cache *cache);
+
+static inline void *kmem_cache_alloc (struct kmem_cache *cache, int flags)
+{
+	return malloc (cache->size);
+}
+
+
+static inline void *kmem_cache_zalloc (struct kmem_cache *cache, int flags)
+{
+	return calloc (1, cache->size);
+}
+
+
+static inline void kmem_cache_free (struct kmem_cache *cache, void *ptr)
+{
+	free (ptr);
+}
+
+
+/*
+ * Locks, atomics and RCU
+ */
+typedef struct {
+	pthread_rwlock_t l;
+} rwlock_t;
+
+#define RW_LOCK_UNLOCKED ((rwlock_t) { PTHREAD_RWLOCK_INITIALIZER })
+#define rwlock_init(lock) pthread_rwlock_init (&(lock)->l, NULL)
+#define read_lock(lock) pthread_rwlock_rdlock (&(lock)->l)
+#define read_unlock(lock) pthread_rwlock_unlock (&(lock)->l)
+#define write_lock(lock) pthread_rwlock_wrlock (&(lock)->l)
+#define write_unlock(lock) pthread_rwlock_unlock (&(lock)->l)
+
+typedef struct {
+	pthread_mutex_t m;
+} spinlock_t;
+
+#define spin_lock_init(lock) pthread_mutex_init (&(lock)->m, NULL)
+#define spin_lock(lock) pthread_mutex_lock (&(lock)->m)
+#define spin_unlock(lock) pthread_mutex_unlock (&(lock)->m)
+
+struct mutex {
+	pthread_mutex_t m;
+};
+
+#define DEFINE_MUTEX(name) struct mutex name = { PTHREAD_MUTEX_INITIALIZER }
+#define mutex_init(lock) pthread_mutex_init (&(lock)->m, NULL)
+#define mutex_lock(lock) pthread_mutex_lock (&(lock)->m)
+#define mutex_trylock(lock) (!pthread_mutex_trylock (&(lock)->m))
+#define mutex_unlock(lock) pthread_mutex_unlock (&(lock)->m)
+#define mutex_lock_interruptible(lock) (pthread_mutex_lock (&(lock)->m), 0)
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+#define ATOMIC_INIT(i) { (i) }
+#define atomic_read(v) __atomic_load_n (&(v)->counter, __ATOMIC_SEQ_CST)
+#define atomic_set(v, i) __atomic_store_n (&(v)->counter, (i), __ATOMIC_SEQ_CST)
+#define atomic_add(i, v) ((void)__atomic_add_fetch (&(v)->counter, (i), __ATOMIC_SEQ_CST))
+#define atomic_inc(v) atomic_add (1, v)
+#define atomic_dec(v) ((void)__atomic_sub_fetch (&(v)->counter, 1, __ATOMIC_SEQ_CST))
+#define atomic_inc_return(v) __atomic_add_fetch (&(v)->counter, 1, __ATOMIC_SEQ_CST)
+#define atomic_dec_and_test(v) (__atomic_sub_fetch (&(v)->counter, 1, __ATOMIC_SEQ_CST) == 0)
+
+typedef struct {
+	s64 counter;
+} atomic64_t;
+
+#define atomic64_read(v) __atomic_load_n (&(v)->counter, __ATOMIC_RELAXED)
+#define atomic64_set(v, i) __atomic_store_n (&(v)->counter, (i), __ATOMIC_RELAXED)
+#define atomic64_add(i, v) ((void)__atomic_add_fetch (&(v)->counter, (i), __ATOMIC_RELAXED))
+#define atomic64_inc(v) atomic64_add (1, v)
+
+#define smp_mb() __atomic_thread_fence (__ATOMIC_SEQ_CST)
+#define smp_wmb() __atomic_thread_fence (__ATOMIC_RELEASE)
+#define smp_rmb() __atomic_thread_fence (__ATOMIC_ACQUIRE)
+
+typedef struct {
+	unsigned int sequence;
+} seqcount_t;
+
+#define seqcount_init(s) ((s)->sequence = 0)
+
+static inline void write_seqcount_begin (seqcount_t *s)
+{
+	__atomic_store_n (&s->sequence, s->sequence + 1, __ATOMIC_RELAXED);
+	smp_wmb ();
+}
+
+
+static inline void write_seqcount_end (seqcount_t *s)
+{
+	smp_wmb ();
+	__atomic_store_n (&s->sequence, s->sequence + 1, __ATOMIC_RELAXED);
+}
+
+
+static inline unsigned int read_seqcount_begin (const seqcount_t *s)
+{
+	unsigned int seq;
+
+	while ((seq = __atomic_load_n (&s->sequence, __ATOMIC_ACQUIRE)) & 1)
+		;
+	return seq;
+}
+
+
+static inline int read_seqcount_retry (const seqcount_t *s, unsigned int seq)
+{
+	smp_rmb ();
+	return __atomic_load_n (&s->sequence, __ATOMIC_RELAXED) != seq;
+}
+
+
+#define rcu_read_lock() do { } while (0)
+#define rcu_read_unlock() do { } while (0)
+#define synchronize_rcu() do { } while (0)
+
+struct kref {
+	atomic_t refcount;
+};
+
+static inline void kref_init (struct kref *kref)
+{
+	atomic_set (&kref->refcount, 1);
+}
+
+
+static inline void kref_get (struct kref *kref)
+{
+	atomic_inc (&kref->refcount);
+}
+
+
+static inline int kref_put (struct kref *kref, void (*release) (struct kref *kref))
+{
+	if (atomic_dec_and_test (&kref->refcount)) {
+		release (kref);
+		return 1;
+	}
+	return 0;
+}
+
+
+/*
+ * Lists
+ */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define INIT_LIST_HEAD(list) do { (list)->next = (list); (list)->prev = (list); } while (0)
+#define list_empty(head) ((head)->next == (head))
+#define list_entry(ptr, type, member) container_of (ptr, type, member)
+
+static inline void list_add (struct list_head *new, struct list_head *head)
+{
+	new->next = head->next;
+	new->prev = head;
+	head->next->prev = new;
+	head->next = new;
+}
+
+
+static inline void list_add_tail (struct list_head *new, struct list_head *head)
+{
+	list_add (new, head->prev);
+}
+
+
+static inline void list_del (struct list_head *entry)
+{
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+}
+
+
+static inline void list_del_init (struct list_head *entry)
+{
+	list_del (entry);
+	INIT_LIST_HEAD (entry);
+}
+
+
+#define list_for_each_entry(pos, head, member)					\
+	for (pos = list_entry ((head)->next, typeof (*pos), member);		\
+	     &pos->member != (head);						\
+	     pos = list_entry (pos->member.next, typeof (*pos), member))
+
+#define list_add_rcu list_add
+#define list_del_rcu list_del
+#define list_for_each_entry_rcu list_for_each_entry
+
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+
+struct hlist_head {
+	struct hlist_node *first;
+};
+
+#define INIT_HLIST_HEAD(head) ((head)->first = NULL)
+#define hlist_entry(ptr, type, member) container_of (ptr, type, member)
+
+static inline void hlist_add_head (struct hlist_node *n, struct hlist_head *h)
+{
+	n->next = h->first;
+	if (h->first)
+		h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+
+static inline void hlist_del (struct hlist_node *n)
+{
+	*n->pprev = n->next;
+	if (n->next)
+		n->next->pprev = n->pprev;
+}
+
+
+/* linux/hash.h */
+static inline u64 hash_64 (u64 val, unsigned int bits)
+{
+	return (val * 0x61c8864680b583ebULL) >> (64 - bits);
+}
+
+
+/*
+ * Time
+ */
+#define NSEC_PER_USEC	1000L
+#define NSEC_PER_MSEC	1000000L
+#define NSEC_PER_SEC	1000000000L
+#define USEC_PER_SEC	1000000L
+
+typedef struct {
+	s64 tv64;
+} ktime_t;
+
+extern ktime_t ktime_get (void);
+
+static inline ktime_t ktime_sub (ktime_t a, ktime_t b)
+{
+	return (ktime_t) { a.tv64 - b.tv64 };
+}
+
+
+static inline ktime_t ktime_add_ns (ktime_t a, u64 ns)
+{
+	return (ktime_t) { a.tv64 + (s64)ns };
+}
+
+
+static inline s64 ktime_to_ns (ktime_t a)
+{
+	return a.tv64;
+}
+
+
+static inline u64 div64_u64 (u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+
+static inline u64 div_u64 (u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+
+/*
+ * Scheduling: workqueue is a pool of threads, wait queues are never waited on (there are
+ * no readers of events in userspace).
+ */
+struct work_struct;
+typedef void (*work_func_t) (struct work_struct *work);
+
+struct work_struct {
+	work_func_t func;
+	struct work_struct *next;
+};
+
+struct workqueue_struct;
+
+#define WQ_UNBOUND	0x01
+#define WQ_HIGHPRI	0x02
+
+#define INIT_WORK(work, f) do { (work)->func = (f); (work)->next = NULL; } while (0)
+
+extern struct workqueue_struct *alloc_workqueue (const char *name, unsigned int flags, int max_active);
+extern void destroy_workqueue (struct workqueue_struct *wq);
+extern int queue_work (struct workqueue_struct *wq, struct work_struct *work);
+
+struct completion {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int done;
+};
+
+extern void init_completion (struct completion *x);
+extern void complete (struct completion *x);
+extern void wait_for_completion (struct completion *x);
+
+typedef struct {
+	int unused;
+} wait_queue_head_t;
+
+#define init_waitqueue_head(q) ((void)(q))
+#define wake_up_interruptible(q) ((void)(q))
+
+#define preempt_disable() do { } while (0)
+#define preempt_enable() do { } while (0)
+#define cond_resched() do { } while (0)
+
+/* benchmark is never interrupted */
+#define current NULL
+#define signal_pending(task) 0
+
+/* linux/sort.h, swap routine is always the default one */
+static inline void sort (void *base, size_t num, size_t size,
+			 int (*cmp) (const void *, const void *),
+			 void (*swap) (void *, void *, int))
+{
+	qsort (base, num, size, cmp);
+}
+
+/* linux/random.h */
+extern void get_random_bytes (void *buf, int nbytes);
+
+/* linux/proc_fs.h, boards have no proc entries */
+struct proc_dir_entry;
+
+/* linux/debugfs.h, there is no debugfs */
+struct dentry;
+
+/*
+ * linux/tracepoint.h, trace events are empty. Trace header is included only once, since
+ * CREATE_TRACE_POINTS is never defined here.
+ */
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...) args
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+	static inline void trace_##name (proto) { }
+
+
+/*
+ * x86: vector registers could be used anywhere in userspace, so FPU sections are empty
+ */
+#if defined (__x86_64__) || defined (__i386__)
+#define X86_FEATURE_XMM2	1
+#define X86_FEATURE_OSXSAVE	2
+#define X86_FEATURE_AVX2	3
+#define X86_FEATURE_AVX512F	4
+
+static inline int boot_cpu_has (int feature)
+{
+	switch (feature) {
+	case X86_FEATURE_XMM2:
+		return __builtin_cpu_supports ("sse2");
+	case X86_FEATURE_AVX2:
+		return __builtin_cpu_supports ("avx2");
+	case X86_FEATURE_AVX512F:
+		return __builtin_cpu_supports ("avx512f");
+	}
+	return 1;
+}
+
+
+#define XCR_XFEATURE_ENABLED_MASK 0
+
+static inline u64 xgetbv (u32 index)
+{
+	u32 eax, edx;
+
+	asm volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+	return eax | ((u64)edx << 32);
+}
+
+
+static inline void kernel_fpu_begin (void) {}
+static inline void kernel_fpu_end (void) {}
+#endif
+
+
+/* Initialize the core like module load does (after parameters are set) */
+extern int kshim_init (void);
+extern void kshim_exit (void);
+
+#endif